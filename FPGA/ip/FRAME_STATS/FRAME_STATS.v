@@ -0,0 +1,206 @@
+// this module computes per-frame statistics of the MIPI_RX pixel stream, so
+// that auto exposure or presence detection needs a few register reads per
+// frame instead of the pixels. the luminance of every pixel is accumulated into
+// a histogram, minimum, maximum and sum, and optionally into the sums of a grid
+// of tiles. the results are latched after the last pixel of every frame and
+// handed to the main clock domain, where they stay stable for a whole frame.
+//
+// oSTATS is a vector of 32 bit words, meant to be connected word by word to
+// the iDATA inputs of jtag_interface, so the MCU can fetch the whole summary
+// with one FPGA.readBurst():
+//   word 0:               [7:0] minimum, [15:8] maximum, [31:16] frame counter
+//   word 1:               sum of all luminance values (mean = sum / pixels)
+//   word 2..pBINS+1:      histogram, number of pixels per bin (luma >> 4 for
+//                         16 bins, luma >> 3 for 32 bins)
+//   pTILES_X * pTILES_Y:  luminance sum per tile, row by row (optional)
+// the frame counter only changes when new results are latched, reading word 0
+// again after the burst detects a read that spans two frames.
+// the luminance is computed by LUMA (FPGA/ip/LUMA), add it to the project too.
+// pHRES and pVRES should be multiples of pTILES_X and pTILES_Y, the remaining
+// pixels on the right and bottom edge are not part of any tile.
+
+module FRAME_STATS
+#(
+parameter pHRES = 640,
+parameter pVRES = 480,
+parameter pBINS = 16,
+parameter pTILES_X = 0,
+parameter pTILES_Y = 0
+)
+(
+  input             iCLK,
+
+  // pixel stream from MIPI_RX
+  input             iMIPI_CLK,
+  input  [23:0]     iMIPI_DATA,
+  input             iMIPI_START,
+  input             iMIPI_DATAVALID,
+
+  // results, main clock domain
+  output [(2+pBINS+pTILES_X*pTILES_Y)*32-1:0] oSTATS,
+  output            oFRAME_DONE
+);
+
+localparam cTILES = pTILES_X*pTILES_Y;
+localparam cWORDS = 2+pBINS+cTILES;
+localparam cBIN_SHIFT = 8-$clog2(pBINS);
+localparam cTILE_W = (pTILES_X==0) ? 1 : pHRES/pTILES_X;
+localparam cTILE_H = (pTILES_Y==0) ? 1 : pVRES/pTILES_Y;
+localparam cTILE_BITS = (cTILES<2) ? 1 : $clog2(cTILES);
+
+// position, MIPI clock domain
+reg [15:0]              rX, rY;
+reg [15:0]              rTX, rTY;
+reg [cTILE_BITS-1:0]    rTILE_ROW, rTILE_IDX;
+reg                     rACTIVE;
+
+// pipeline stage, luminance of the current pixel
+reg [7:0]               rLUMA;
+reg                     rPIX;
+reg                     rPIX_LAST;
+reg                     rPIX_TILE;
+reg [cTILE_BITS-1:0]    rPIX_IDX;
+reg                     rCLEAR;
+reg                     rLATCH;
+
+// accumulators
+reg [7:0]               rMIN, rMAX;
+reg [31:0]              rSUM;
+reg [31:0]              rHIST [0:pBINS-1];
+reg [31:0]              rTILE [0:(cTILES==0) ? 0 : cTILES-1];
+
+// latched results
+reg [cWORDS*32-1:0]     rRESULT;
+reg [15:0]              rFRAME;
+reg                     rFRAME_TOGGLE;
+
+wire [7:0]              wLUMA;
+wire                    wIN_TILES;
+
+LUMA luma_inst
+(
+  .iRGB(iMIPI_DATA),
+  .oLUMA(wLUMA)
+);
+
+assign wIN_TILES = (cTILES!=0)&&(rX<pTILES_X*cTILE_W)&&(rY<pTILES_Y*cTILE_H);
+
+integer i;
+
+initial begin
+  rACTIVE<=0;
+  rPIX<=0;
+  rCLEAR<=0;
+  rLATCH<=0;
+  rFRAME<=0;
+  rFRAME_TOGGLE<=0;
+  rRESULT<=0;
+end
+
+always @(posedge iMIPI_CLK)
+begin
+  rPIX<=0;
+  rCLEAR<=0;
+  if (iMIPI_DATAVALID) begin
+    if (iMIPI_START) begin
+      // new frame
+      rX<=0;
+      rY<=0;
+      rTX<=0;
+      rTY<=0;
+      rTILE_ROW<=0;
+      rTILE_IDX<=0;
+      rACTIVE<=1;
+      rCLEAR<=1;
+    end
+    else if (rACTIVE) begin
+      rLUMA<=wLUMA;
+      rPIX<=1;
+      rPIX_LAST<=(rX==pHRES-1)&&(rY==pVRES-1);
+      rPIX_TILE<=wIN_TILES;
+      rPIX_IDX<=rTILE_IDX;
+
+      rTX<=rTX+1;
+      if (rTX==cTILE_W-1) begin
+        rTX<=0;
+        rTILE_IDX<=rTILE_IDX+1;
+      end
+
+      // end of line
+      if (rX==pHRES-1) begin
+        rX<=0;
+        rY<=rY+1;
+        rTX<=0;
+        rTY<=rTY+1;
+        rTILE_IDX<=rTILE_ROW;
+        if (rTY==cTILE_H-1) begin
+          rTY<=0;
+          rTILE_ROW<=rTILE_ROW+pTILES_X;
+          rTILE_IDX<=rTILE_ROW+pTILES_X;
+        end
+        if (rY==pVRES-1)
+          rACTIVE<=0;
+      end
+      else
+        rX<=rX+1;
+    end
+  end
+
+  // accumulate
+  rLATCH<=rPIX&&rPIX_LAST;
+  if (rCLEAR) begin
+    rMIN<=8'hff;
+    rMAX<=0;
+    rSUM<=0;
+    for (i=0; i<pBINS; i=i+1)
+      rHIST[i]<=0;
+    for (i=0; i<cTILES; i=i+1)
+      rTILE[i]<=0;
+  end
+  else if (rPIX) begin
+    if (rLUMA<rMIN) rMIN<=rLUMA;
+    if (rLUMA>rMAX) rMAX<=rLUMA;
+    rSUM<=rSUM+rLUMA;
+    rHIST[rLUMA>>cBIN_SHIFT]<=rHIST[rLUMA>>cBIN_SHIFT]+1;
+    if (rPIX_TILE)
+      rTILE[rPIX_IDX]<=rTILE[rPIX_IDX]+rLUMA;
+  end
+
+  // frame complete, the accumulators are kept until the next frame start
+  if (rLATCH) begin
+    rRESULT[31:0]<={rFRAME+16'd1,rMAX,rMIN};
+    rRESULT[63:32]<=rSUM;
+    for (i=0; i<pBINS; i=i+1)
+      rRESULT[(2+i)*32+:32]<=rHIST[i];
+    for (i=0; i<cTILES; i=i+1)
+      rRESULT[(2+pBINS+i)*32+:32]<=rTILE[i];
+    rFRAME<=rFRAME+1;
+    rFRAME_TOGGLE<=!rFRAME_TOGGLE;
+  end
+end
+
+// results, main clock domain. rRESULT is stable when the synchronized toggle
+// changes, so it can be sampled safely
+reg [2:0]               rTOGGLE_SYNC;
+reg [cWORDS*32-1:0]     rSTATS;
+reg                     rDONE;
+
+initial begin
+  rSTATS<=0;
+  rDONE<=0;
+end
+
+always @(posedge iCLK)
+begin
+  rTOGGLE_SYNC<={rTOGGLE_SYNC[1:0],rFRAME_TOGGLE};
+  rDONE<=0;
+  if (rTOGGLE_SYNC[2]!=rTOGGLE_SYNC[1]) begin
+    rSTATS<=rRESULT;
+    rDONE<=1;
+  end
+end
+
+assign oSTATS = rSTATS;
+assign oFRAME_DONE = rDONE;
+
+endmodule
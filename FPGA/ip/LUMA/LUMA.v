@@ -0,0 +1,17 @@
+// this module converts an RGB888 pixel of the MIPI_RX stream into 8 bit
+// luminance, Y = 0.30 R + 0.59 G + 0.11 B, with the weights 77, 150 and 29
+// out of 256. the products are summed in 16 bits, the result is the upper
+// byte. shared by ROI_READER and FRAME_STATS, add it to the project with them.
+
+module LUMA
+(
+  input  [23:0]     iRGB,
+  output [7:0]      oLUMA
+);
+
+wire [15:0]             wSUM;
+
+assign wSUM = {8'b0,iRGB[23:16]}*16'd77 + {8'b0,iRGB[15:8]}*16'd150 + {8'b0,iRGB[7:0]}*16'd29;
+assign oLUMA = wSUM[15:8];
+
+endmodule
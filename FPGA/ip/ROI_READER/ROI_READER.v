@@ -0,0 +1,251 @@
+// this module captures a rectangular region of interest from the MIPI_RX pixel
+// stream, so that the MCU does not have to pull whole frames out of SDRAM.
+// the region is converted to 8 bit luminance, optionally decimated or binned,
+// and packed 4 pixels per 32 bit word (first pixel in the LSBs) into a double
+// buffered block ram. the MCU reads the finished buffer with JTAG_BRIDGE bursts
+// (avalon slave below), while the next frame is captured into the other one.
+//
+// configuration, usually connected to two jtag_interface output registers:
+//   iROI_POSITION: [15:0] x of the first source pixel, [31:16] y
+//   iROI_SIZE:     [9:0] output width, [19:10] output height, [23:20] step,
+//                  [24] binning (average step x step pixels instead of taking
+//                  the first one, step must be 1, 2, 4 or 8)
+// the configuration is taken at every frame start. the region must lie inside
+// the frame (x + width * step <= pHRES, the same for y and the frame height),
+// a region that runs past the last line is never completed.
+// output width * height must be a multiple of 4 and fit into pBANK_WORDS words,
+// the output width is limited to pMAX_WIDTH (the size of the binning line
+// buffer). pBANK_WORDS must be a power of two.
+//
+// the luminance is computed by LUMA (FPGA/ip/LUMA), add it to the project too.
+//
+// status, usually connected to a jtag_interface input register:
+//   oROI_STATUS:   [0] bank holding the last complete frame, [15:1] frame
+//                  counter (0 until the first frame, then 1..32767),
+//                  [20:16] log2 of the bank size in words (word offset of
+//                  bank 1), [31:21] pMAX_WIDTH
+
+module ROI_READER
+#(
+parameter pHRES = 640,
+parameter pBANK_WORDS = 1024,
+parameter pMAX_WIDTH = 128
+)
+(
+  input             iCLK,
+  input             iRESET,
+
+  // pixel stream from MIPI_RX
+  input             iMIPI_CLK,
+  input  [23:0]     iMIPI_DATA,
+  input             iMIPI_START,
+  input             iMIPI_DATAVALID,
+
+  // configuration and status
+  input  [31:0]     iROI_POSITION,
+  input  [31:0]     iROI_SIZE,
+  output [31:0]     oROI_STATUS,
+
+  // avalon slave, connect to JTAG_BRIDGE
+  input  [31:0]     iAVL_ADDRESS,
+  input             iAVL_READ,
+  input             iAVL_WRITE,
+  input  [4:0]      iAVL_BURST_COUNT,
+  output [31:0]     oAVL_READ_DATA,
+  output            oAVL_READ_DATA_VALID,
+  output            oAVL_WAIT_REQUEST
+);
+
+localparam cADDRESS_BITS = $clog2(pBANK_WORDS);
+
+// the banks are addressed as {bank,word}
+generate
+  if ((1<<cADDRESS_BITS)!=pBANK_WORDS) begin : gBANK_WORDS_CHECK
+    $error("ROI_READER: pBANK_WORDS must be a power of two");
+  end
+endgenerate
+
+reg [31:0]              rMEM [0:2*pBANK_WORDS-1];
+
+// capture side, MIPI clock domain
+reg [15:0]              rX, rY;
+reg [15:0]              rX0, rY0;
+reg [9:0]               rW, rH;
+reg [3:0]               rSTEP;
+reg                     rBIN;
+reg [2:0]               rSHIFT;
+reg [9:0]               rOUTX, rOUTY;
+reg [3:0]               rXPH, rYPH;
+reg [13:0]              rHSUM;
+reg [13:0]              rACC [0:pMAX_WIDTH-1];
+reg [31:0]              rWORD;
+reg [1:0]               rPIXCNT;
+reg [cADDRESS_BITS-1:0] rWADDR;
+reg                     rBANK, rREADY_BANK;
+reg [14:0]              rFRAME;
+reg                     rFRAME_TOGGLE;
+reg                     rEMIT;
+reg [7:0]               rPIXEL;
+
+wire [7:0]              wLUMA;
+wire [13:0]             wCOLSUM;
+wire [13:0]             wBINSUM;
+wire                    wIN_ROI;
+wire                    wLAST_COLUMN;
+
+LUMA luma_inst
+(
+  .iRGB(iMIPI_DATA),
+  .oLUMA(wLUMA)
+);
+
+assign wCOLSUM = (rXPH==0) ? wLUMA : rHSUM+wLUMA;
+assign wBINSUM = (rYPH==0) ? wCOLSUM : rACC[rOUTX]+wCOLSUM;
+assign wIN_ROI = (rY>=rY0)&&(rOUTY<rH)&&(rX>=rX0)&&(rOUTX<rW);
+assign wLAST_COLUMN = (rXPH==rSTEP-1);
+
+initial begin
+  rBANK<=0;
+  rREADY_BANK<=1;
+  rFRAME<=0;
+  rFRAME_TOGGLE<=0;
+  rOUTY<=0;
+  rH<=0;
+end
+
+always @(posedge iMIPI_CLK)
+begin
+  rEMIT<=0;
+  if (iMIPI_DATAVALID) begin
+    if (iMIPI_START) begin
+      // new frame, take configuration
+      rX<=0;
+      rY<=0;
+      rX0<=iROI_POSITION[15:0];
+      rY0<=iROI_POSITION[31:16];
+      rW<=(iROI_SIZE[9:0]>pMAX_WIDTH) ? pMAX_WIDTH : iROI_SIZE[9:0];
+      rH<=iROI_SIZE[19:10];
+      rSTEP<=(iROI_SIZE[23:20]==0) ? 1 : iROI_SIZE[23:20];
+      rBIN<=iROI_SIZE[24];
+      rSHIFT<=(iROI_SIZE[23:20]==8) ? 6 : (iROI_SIZE[23:20]==4) ? 4 : (iROI_SIZE[23:20]==2) ? 2 : 0;
+      rOUTX<=0;
+      rOUTY<=0;
+      rXPH<=0;
+      rYPH<=0;
+      rPIXCNT<=0;
+      rWADDR<=0;
+    end
+    else begin
+      if (wIN_ROI) begin
+        rHSUM<=wCOLSUM;
+        rXPH<=rXPH+1;
+        if (!rBIN&&rXPH==0&&rYPH==0) begin
+          // decimation: first pixel of every step x step block
+          rPIXEL<=wLUMA;
+          rEMIT<=1;
+        end
+        if (wLAST_COLUMN) begin
+          rXPH<=0;
+          rOUTX<=rOUTX+1;
+          if (rBIN) begin
+            rACC[rOUTX]<=wBINSUM;
+            if (rYPH==rSTEP-1) begin
+              rPIXEL<=wBINSUM>>rSHIFT;
+              rEMIT<=1;
+            end
+          end
+        end
+      end
+
+      // end of line
+      if (rX==pHRES-1) begin
+        rX<=0;
+        rY<=rY+1;
+        rOUTX<=0;
+        rXPH<=0;
+        if ((rY>=rY0)&&(rOUTY<rH)) begin
+          rYPH<=rYPH+1;
+          if (rYPH==rSTEP-1) begin
+            rYPH<=0;
+            rOUTY<=rOUTY+1;
+          end
+        end
+      end
+      else
+        rX<=rX+1;
+    end
+  end
+
+  // pack pixels into words
+  if (rEMIT) begin
+    rWORD<={rPIXEL,rWORD[31:8]};
+    rPIXCNT<=rPIXCNT+1;
+    if (rPIXCNT==3) begin
+      rMEM[{rBANK,rWADDR}]<={rPIXEL,rWORD[31:8]};
+      rWADDR<=rWADDR+1;
+    end
+  end
+
+  // region complete: hand the bank over to the MCU right away
+  if (rOUTY==rH&&rH!=0&&!iMIPI_START&&!rEMIT&&rWADDR!=0) begin
+    rREADY_BANK<=rBANK;
+    rBANK<=!rBANK;
+    rFRAME<=(rFRAME==15'h7fff) ? 15'd1 : rFRAME+15'd1;
+    rFRAME_TOGGLE<=!rFRAME_TOGGLE;
+    rWADDR<=0;
+  end
+end
+
+// status, main clock domain. bank and frame counter are stable when the
+// synchronized toggle changes, so they can be sampled safely
+reg [2:0]               rTOGGLE_SYNC;
+reg [31:0]              rSTATUS;
+
+initial rSTATUS<={11'(pMAX_WIDTH),5'(cADDRESS_BITS),15'd0,1'b0};
+
+always @(posedge iCLK)
+begin
+  rTOGGLE_SYNC<={rTOGGLE_SYNC[1:0],rFRAME_TOGGLE};
+  if (rTOGGLE_SYNC[2]!=rTOGGLE_SYNC[1])
+    rSTATUS<={11'(pMAX_WIDTH),5'(cADDRESS_BITS),rFRAME,rREADY_BANK};
+end
+
+assign oROI_STATUS = rSTATUS;
+
+// avalon slave, burst reads from the buffer, writes are ignored
+reg [cADDRESS_BITS:0]   rRADDR;
+reg [4:0]               rBURST;
+reg                     rREADING;
+reg [31:0]              rQ;
+reg                     rVALID;
+
+initial begin
+  rREADING<=0;
+  rVALID<=0;
+end
+
+always @(posedge iCLK)
+begin
+  rQ<=rMEM[rRADDR];
+  rVALID<=rREADING;
+  if (iRESET) begin
+    rREADING<=0;
+  end
+  else if (rREADING) begin
+    rRADDR<=rRADDR+1;
+    rBURST<=rBURST-1;
+    if (rBURST==1)
+      rREADING<=0;
+  end
+  else if (iAVL_READ) begin
+    rRADDR<=iAVL_ADDRESS[cADDRESS_BITS:0];
+    rBURST<=(iAVL_BURST_COUNT==0) ? 1 : iAVL_BURST_COUNT;
+    rREADING<=1;
+  end
+end
+
+assign oAVL_READ_DATA       = rQ;
+assign oAVL_READ_DATA_VALID = rVALID;
+assign oAVL_WAIT_REQUEST    = rREADING;
+
+endmodule
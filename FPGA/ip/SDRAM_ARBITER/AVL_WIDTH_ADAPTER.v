@@ -0,0 +1,113 @@
+// this module connects the 32 bit JTAG_BRIDGE avalon master to the 16 bit
+// avalon client port of SDRAM_ARBITER, so that the MCU can read and patch
+// the SDRAM (camera buffers, framebuffer) at full JTAG speed.
+// addresses on the bridge side are in 32 bit words, every word is split into
+// two 16 bit beats (low half first) on the arbiter side.
+// writes are posted: the bridge is released as soon as the word is latched.
+
+module AVL_WIDTH_ADAPTER
+#(
+parameter pADDRESS_BITS = 22
+)
+(
+  input                      iCLK,
+  input                      iRESET,
+
+  // 32 bit slave, connect to JTAG_BRIDGE
+  input  [31:0]              iJTAG_ADDRESS,
+  input                      iJTAG_WRITE,
+  input                      iJTAG_READ,
+  input  [31:0]              iJTAG_WRITE_DATA,
+  output [31:0]              oJTAG_READ_DATA,
+  input  [4:0]               iJTAG_BURST_COUNT,
+  output                     oJTAG_WAIT_REQUEST,
+  output                     oJTAG_READ_DATA_VALID,
+
+  // 16 bit master, connect to the avalon port of SDRAM_ARBITER
+  output [pADDRESS_BITS-1:0] oAVL_ADDRESS,
+  output                     oAVL_READ,
+  output                     oAVL_WRITE,
+  input                      iAVL_WAIT_REQUEST,
+  input  [15:0]              iAVL_READ_DATA,
+  input                      iAVL_READ_DATA_VALID,
+  output [15:0]              oAVL_WRITE_DATA,
+  output [1:0]               oAVL_BYTE_ENABLE,
+  output [5:0]               oAVL_BURST_COUNT
+);
+
+localparam cIDLE    = 0,
+           cWR_LO   = 1,
+           cWR_HI   = 2,
+           cRD_CMD  = 3,
+           cRD_DATA = 4;
+
+reg [2:0]                  rSTATE;
+reg [pADDRESS_BITS-1:0]    rADDRESS;
+reg [31:0]                 rDATA;
+reg [5:0]                  rBEATS;
+reg [15:0]                 rLOW;
+reg                        rHALF;
+reg                        rREAD_DATA_VALID;
+
+initial begin
+  rSTATE<=cIDLE;
+  rHALF<=0;
+  rREAD_DATA_VALID<=0;
+end
+
+// requests are accepted only while idle
+assign oJTAG_WAIT_REQUEST    = (rSTATE!=cIDLE);
+assign oJTAG_READ_DATA       = rDATA;
+assign oJTAG_READ_DATA_VALID = rREAD_DATA_VALID;
+
+assign oAVL_ADDRESS     = rADDRESS;
+assign oAVL_WRITE       = (rSTATE==cWR_LO)||(rSTATE==cWR_HI);
+assign oAVL_READ        = (rSTATE==cRD_CMD);
+assign oAVL_WRITE_DATA  = (rSTATE==cWR_HI) ? rDATA[31:16] : rDATA[15:0];
+assign oAVL_BYTE_ENABLE = 2'd3;
+assign oAVL_BURST_COUNT = rBEATS;
+
+always @(posedge iCLK)
+begin
+  rREAD_DATA_VALID<=0;
+  if (iRESET) begin
+    rSTATE<=cIDLE;
+    rHALF<=0;
+  end else begin
+    case (rSTATE)
+      cIDLE: begin
+        rADDRESS<={iJTAG_ADDRESS,1'b0};
+        rDATA<=iJTAG_WRITE_DATA;
+        rHALF<=0;
+        if (iJTAG_WRITE) begin
+          rBEATS<=2;
+          rSTATE<=cWR_LO;
+        end
+        else if (iJTAG_READ) begin
+          rBEATS<=(iJTAG_BURST_COUNT==0) ? 2 : {iJTAG_BURST_COUNT,1'b0};
+          rSTATE<=cRD_CMD;
+        end
+      end
+      cWR_LO: if (!iAVL_WAIT_REQUEST) rSTATE<=cWR_HI;
+      cWR_HI: if (!iAVL_WAIT_REQUEST) rSTATE<=cIDLE;
+      cRD_CMD: if (!iAVL_WAIT_REQUEST) rSTATE<=cRD_DATA;
+      cRD_DATA: begin
+        // pack pairs of 16 bit beats into words for the bridge
+        if (iAVL_READ_DATA_VALID) begin
+          rHALF<=!rHALF;
+          rBEATS<=rBEATS-1;
+          if (!rHALF)
+            rLOW<=iAVL_READ_DATA;
+          else begin
+            rDATA<={iAVL_READ_DATA,rLOW};
+            rREAD_DATA_VALID<=1;
+          end
+          if (rBEATS==1)
+            rSTATE<=cIDLE;
+        end
+      end
+    endcase
+  end
+end
+
+endmodule
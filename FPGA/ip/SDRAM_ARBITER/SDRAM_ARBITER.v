@@ -25,7 +25,14 @@ parameter pCAM_OFFSET_A = 0,
 parameter pCAM_OFFSET_B = 640*480,
 parameter pFB_OFFSET = 2*640*480,
 parameter pFB_SIZE = 640*480,
-parameter pADDRESS_BITS = 22
+parameter pADDRESS_BITS = 22,
+// bandwidth budget of the avalon client port. within every window of
+// pAVL_BUDGET_PERIOD memory clocks the port is granted at most
+// pAVL_BUDGET_BEATS beats, so camera and video fifos can always be refilled.
+// a period of 0 disables the budget. pAVL_BUDGET_BEATS must be at least the
+// longest burst issued on the port.
+parameter pAVL_BUDGET_PERIOD = 0,
+parameter pAVL_BUDGET_BEATS = 64
 )
 (
   input                      iFB_CLK,
@@ -101,6 +108,11 @@ reg                        rAVL_ACTIVE;
 reg                        rAVL_WAIT;
 reg  [15:0]                rAVL_WRITEDATA;
 reg  [1:0]                 rBYTEENABLE;
+reg  [15:0]                rAVL_WINDOW;
+reg  [15:0]                rAVL_CREDIT;
+wire [6:0]                 wAVL_BEATS;
+wire                       wAVL_ALLOWED;
+wire                       wAVL_GRANT;
 
 initial begin
   rMIPI_UNLOCK<=0;
@@ -119,6 +131,8 @@ initial begin
   rAVL_ACTIVE<=0;
   rAVL_WAIT <=1;
   rBUFFER<=0;
+  rAVL_WINDOW<=0;
+  rAVL_CREDIT<=pAVL_BUDGET_BEATS;
 end
 
   dcfifo #(
@@ -257,6 +271,15 @@ scfifo #(
 
 assign oFB_DATA_VALID=!wFB_FIFO_EMPTY&!wFB_FIFO2_EMPTY&&(wFB_FIFO2_USEDW>pBURST_SIZE/3);
 
+assign wAVL_BEATS = (iAVL_BURST_COUNT==0) ? 1 : iAVL_BURST_COUNT;
+assign wAVL_ALLOWED = (pAVL_BUDGET_PERIOD==0) || (rAVL_CREDIT>=wAVL_BEATS);
+// avalon client is granted only when neither camera nor video need the memory
+assign wAVL_GRANT = !rWRITE&&!rREAD&&
+                    !(wMIPI_FIFO_DATA[15]&!rMIPI_UNLOCK)&&
+                    !(wMIPI_FIFO_USEDW>pBURST_SIZE)&&
+                    !(wFB_FIFO_USEDW<2*pBURST_SIZE)&&
+                    (iAVL_READ|iAVL_WRITE)&&wAVL_ALLOWED;
+
 assign oAVL_WAIT_REQUEST=rAVL_WAIT|iSDRAM_WAIT_REQUEST;
 assign oAVL_READ_DATA = iSDRAM_READ_DATA;
 assign oAVL_READ_DATA_VALID = iSDRAM_READ_DATA_VALID&&(rCURRENT_CLIENT==2'd2);
@@ -273,11 +296,24 @@ begin
     rCURRENT_BURSTCNT<=0;
     rAVL_WAIT <=1;
     rBUFFER<=0;
+    rAVL_WINDOW<=0;
+    rAVL_CREDIT<=pAVL_BUDGET_BEATS;
   end else begin
     rCMD_WRITE<=0;
     rCMD_READ<=0;
     rAVL_WAIT<=1;
 
+    // refill avalon budget at the start of every window, charge every grant
+    if (rAVL_WINDOW==0) begin
+      rAVL_WINDOW<=pAVL_BUDGET_PERIOD-1;
+      rAVL_CREDIT<=pAVL_BUDGET_BEATS-(wAVL_GRANT ? wAVL_BEATS : 0);
+    end
+    else begin
+      rAVL_WINDOW<=rAVL_WINDOW-1;
+      if (wAVL_GRANT)
+        rAVL_CREDIT<=rAVL_CREDIT-wAVL_BEATS;
+    end
+
     if (rCMD_WRITE&!rREAD&rFB_START) begin
       rFB_START<=0;
     end
@@ -299,8 +335,10 @@ begin
         rBURSTCNT <=pBURST_SIZE-1;
         rADDRESS<=rWRITE_ADDRESS+(rBUFFER ? pCAM_OFFSET_A : pCAM_OFFSET_B);
       end
-      // else check if there is enough room in FB FIFO
-      else if (wFB_FIFO_USEDW<pBURST_SIZE) begin
+      // else check if there is enough room in FB FIFO. refill below two
+      // bursts, one burst is not enough to cover a camera burst granted
+      // first and the latency of both fb bursts
+      else if (wFB_FIFO_USEDW<2*pBURST_SIZE) begin
         rREAD<=1;
         rBYTEENABLE<=2'd3;
         rCMD_WRITE<=1;
@@ -308,7 +346,8 @@ begin
         rBURSTCNT <=pBURST_SIZE-1;
         rADDRESS<=rREAD_ADDRESS+(rBUFFER ? pCAM_OFFSET_B : pCAM_OFFSET_A);
       end
-      else if (iAVL_READ) begin
+      // avalon client has the lowest priority and is limited by its budget
+      else if (iAVL_READ&&wAVL_ALLOWED) begin
         rREAD <=1;
         rBYTEENABLE<=iAVL_BYTE_ENABLE;
         rCMD_WRITE<=1;
@@ -317,7 +356,7 @@ begin
         rADDRESS<=iAVL_ADDRESS;
         rAVL_WAIT<=0;
       end
-      else if (iAVL_WRITE) begin
+      else if (iAVL_WRITE&&wAVL_ALLOWED) begin
         rWRITE<=1;
         rBURSTCNT <= (iAVL_BURST_COUNT==0) ? 0: iAVL_BURST_COUNT-1;
         rADDRESS<=iAVL_ADDRESS;
@@ -66,9 +66,6 @@ begin
   else if (!rWAITDELAY[3])
     rWAITDELAY<=rWAITDELAY+1;
 
-  if (!wAVL_WAITREQUEST)
-    rAVL_WRITE<=!rAVL_WRITE;
-
   if (rDELAY[15])
     rSDRAM_DATA<=rSDRAM_DATA+1;
 end
@@ -82,34 +79,138 @@ begin
   rDVS <= fb_vport_vs;
   if (fb_vport_de) rMIPI_DATA <= rMIPI_DATA+1;
 end
+// avalon client traffic: back to back bursts of 8 beats, alternating
+// between reads and writes, as the jtag bridge would issue them
+reg rAVL_READ;
+reg [3:0] rAVL_BEATS;
+initial begin
+  rAVL_READ<=0;
+  rAVL_BEATS<=0;
+end
+
+always @(posedge rMAIN_CLK)
+begin
+  if (rAVL_WRITE&!wAVL_WAITREQUEST) begin
+    rAVL_BEATS<=rAVL_BEATS+1;
+    if (rAVL_BEATS==7) begin
+      rAVL_BEATS<=0;
+      rAVL_WRITE<=0;
+      rAVL_READ<=1;
+    end
+  end
+  else if (rAVL_READ&!wAVL_WAITREQUEST) begin
+    rAVL_READ<=0;
+  end
+  else if (!rAVL_WRITE&!rAVL_READ) begin
+    rAVL_WRITE<=1;
+  end
+end
+
+// throughput counters, in beats per client
+integer nCLOCKS, nMIPI, nFB, nAVL;
+initial begin
+  nCLOCKS=0;
+  nMIPI=0;
+  nFB=0;
+  nAVL=0;
+end
+
+always @(posedge rMAIN_CLK)
+begin
+  nCLOCKS=nCLOCKS+1;
+  if (sdram_arbiter_0_sdram_write&!sdram_arbiter_0_sdram_wait)
+    if (sdram_arbiter_0.rAVL_ACTIVE) nAVL=nAVL+1;
+    else nMIPI=nMIPI+1;
+  if (rDELAY[15])
+    if (sdram_arbiter_0.rCURRENT_CLIENT==2) nAVL=nAVL+1;
+    else nFB=nFB+1;
+end
+
+// fifo checks. the camera fifo must never drop a pixel, no fifo may be
+// written while full or read while empty, and once the first frame started
+// the video fifos must deliver a pixel in every clock of the visible area
+integer nERRORS;
+reg rVIDEO_STARTED;
+initial begin
+  nERRORS=0;
+  rVIDEO_STARTED<=0;
+end
+
+task fifo_error(input [8*40-1:0] what);
+begin
+  if (nERRORS<10) $display("ERROR at %0t ps: %0s", $time, what);
+  nERRORS=nERRORS+1;
+end
+endtask
+
+always @(posedge rVID_CLK)
+begin
+  if (fb_vport_de&sdram_arbiter_0.wMIPI_FIFO_FULL)
+    fifo_error("camera fifo overflow");
+  if (sdram_arbiter_0.fb_fifo.rdreq&sdram_arbiter_0.fb_fifo.rdempty|
+      sdram_arbiter_0.fb_fifo2.rdreq&sdram_arbiter_0.fb_fifo2.rdempty)
+    fifo_error("video fifo read while empty");
+  if (fb_st_start&fbst_0.rVBLANK)
+    rVIDEO_STARTED<=1;
+  if (rVIDEO_STARTED&fb_vport_de&!fb_st_dv)
+    fifo_error("video fifo underflow");
+end
+
+always @(posedge rMAIN_CLK)
+begin
+  if (sdram_arbiter_0.mipi_fifo.rdreq&sdram_arbiter_0.mipi_fifo.rdempty)
+    fifo_error("camera fifo underflow");
+  if (sdram_arbiter_0.fb_fifo.wrreq&sdram_arbiter_0.fb_fifo.wrfull|
+      sdram_arbiter_0.fb_fifo2.wrreq&sdram_arbiter_0.fb_fifo2.wrfull)
+    fifo_error("video fifo overflow");
+  if (sdram_arbiter_0.cmd_fifo.wrreq&sdram_arbiter_0.cmd_fifo.full)
+    fifo_error("command fifo overflow");
+end
+
+initial begin
+  #900000000;
+  $display("clocks %0d: camera %0d%%, video %0d%%, avalon %0d%% of memory bandwidth",
+           nCLOCKS, nMIPI*100/nCLOCKS, nFB*100/nCLOCKS, nAVL*100/nCLOCKS);
+  if (!rVIDEO_STARTED)
+    fifo_error("video never started");
+  if (nERRORS==0) $display("PASSED");
+  else $display("FAILED: %0d errors", nERRORS);
+  $finish;
+end
+
    SDRAM_ARBITER #(
        .pBURST_SIZE(64),
        .pFB_OFFSET(640*4),
-       .pFB_SIZE(640*4)
+       .pFB_SIZE(640*4),
+       .pAVL_BUDGET_PERIOD(256),
+       .pAVL_BUDGET_BEATS(32)
    
         )sdram_arbiter_0 (
 		.oSDRAM_ADDRESS        (),       // sdram.address
 		.oSDRAM_WRITE          (sdram_arbiter_0_sdram_write),         //      .write
 		.oSDRAM_READ           (sdram_arbiter_0_sdram_read),          //      .read
-		.oSDRAM_WRITEDATA      (),     //      .writedata
+		.oSDRAM_WRITE_DATA     (),     //      .writedata
 		.iSDRAM_READ_DATA      (rSDRAM_DATA),      //      .readdata
-		.iSDRAM_WAITREQUEST    (sdram_arbiter_0_sdram_wait),   //      .waitrequest
-		.iSDRAM_READ_DATAVALID (rDELAY[15]), //      .readdatavalid
+		.iSDRAM_WAIT_REQUEST   (sdram_arbiter_0_sdram_wait),   //      .waitrequest
+		.iSDRAM_READ_DATA_VALID(rDELAY[15]), //      .readdatavalid
 		.iMEM_CLK              (rMAIN_CLK),                             // clock.clk
 		.iRESET                (1'b0),      // reset.reset
 		.iFB_CLK               (rVID_CLK),                          //    fb.clk
 		.iFB_READY             (fb_st_ready),                          //      .rdy
 		.oFB_DATA              (fb_st_data),                         //      .data
-		.oFB_DATAVALID         (fb_st_dv),                           //      .dv
+		.oFB_DATA_VALID        (fb_st_dv),                           //      .dv
 		.oFB_START             (fb_st_start),                        //      .start
 		.iMIPI_CLK             (rVID_CLK),                        //  mipi.clk
 		.iMIPI_DATA            (rMIPI_DATA),                       //      .data
-		.iMIPI_DATAVALID       (fb_vport_de),                         //      .dv
+		.iMIPI_DATA_VALID      (fb_vport_de),                         //      .dv
 		.iMIPI_START           (fb_vport_vs&!rDVS),                       //      .start
-                .iAVL_WRITE            (0&rAVL_WRITE),
-                .iAVL_READ             (0&!rAVL_WRITE),
-                .oAVL_WAITREQUEST      (wAVL_WAITREQUEST),
-                .iAVL_BURSTCOUNT       (1)
+                .iAVL_ADDRESS          (22'h200000),
+                .iAVL_WRITE            (rAVL_WRITE),
+                .iAVL_READ             (rAVL_READ),
+                .oAVL_WAIT_REQUEST     (wAVL_WAITREQUEST),
+                .iAVL_WRITE_DATA       (16'h5a5a),
+                .iAVL_BYTE_ENABLE      (2'd3),
+                .iAVL_BURST_COUNT      (6'd8)
 	);
 
 endmodule
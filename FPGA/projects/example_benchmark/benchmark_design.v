@@ -0,0 +1,76 @@
+//
+// Design of the benchmark bitstream, used with examples/benchmark. jtag_interface runs with MONITOR = 1 and
+//   measures its own bus load, so every optimization of the Arduino library can be checked against the clock
+//   of the FPGA instead of the timers of the Arduino.
+//
+//   Input registers:
+//     0 to 7    counters of jtag_monitor.v (scans, updates, TCK edges, busy and idle clocks, idle gaps, TCK window)
+//     8         tick at which output register 8 last changed, for FPGATiming::measureWriteLatency()
+//     9         tick counter, 120 MHz like in example_simple
+//     10 to 15  loopback of the output registers 10 to 15
+//
+//   Output registers 0 to 7 are not connected, they can be written freely.
+//
+// The jtag_... files and latency_probe.v are taken from example_simple.
+//
+
+module benchmark_design (
+	input iCLK_MAIN
+);
+
+localparam NUMBER_OF_REGISTERS = 16;
+localparam REGISTER_SIZE = 32;
+
+wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] iDATA;
+wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] oDATA;
+wire [7:0][31:0] monitor;
+wire [31:0] probeTicks;
+
+reg [31:0] ticks = 'b0;
+
+always @(posedge iCLK_MAIN) ticks <= ticks + 1'b1;
+
+jtag_interface #(
+
+	.REGISTER_SIZE(REGISTER_SIZE),
+	.NUMBER_OF_REGISTERS(NUMBER_OF_REGISTERS),
+	.PROBE_REGISTERS(16'h0100),		// Register 8
+	.TIMESTAMP_WIDTH(32),
+	.MONITOR(1)
+	
+) jtag_inst (
+
+	.iMAIN_CLK(iCLK_MAIN),
+	.iDATA(iDATA),
+	.oDATA(oDATA),
+	.iFIFO_WRITE('b0),
+	.iFIFO_READ('b0),
+	.oFIFO_VALID(),
+	.oINTERRUPT(),
+	.oMONITOR(monitor)
+
+);
+
+latency_probe probe (
+
+	.iCLK(iCLK_MAIN),
+	.iDATA(oDATA[8]),
+	.iTICKS(ticks),
+	.oTICKS(probeTicks)
+
+);
+
+genvar k;
+generate
+	for (k = 0; k < 8; k = k + 1) begin : counters
+		assign iDATA[k] = monitor[k];
+	end
+	for (k = 10; k < NUMBER_OF_REGISTERS; k = k + 1) begin : loopback
+		assign iDATA[k] = oDATA[k];
+	end
+endgenerate
+
+assign iDATA[8] = probeTicks;
+assign iDATA[9] = ticks;
+
+endmodule
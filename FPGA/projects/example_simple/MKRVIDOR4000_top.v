@@ -162,6 +162,7 @@ SYSTEM_PLL PLL_inst(
 
 // ================================================
 // Your design here
+// (Connect oINTERRUPT of a jtag_interface to oSAM_INT to use FPGA.attachChangeInterrupt())
 
 
 MyDesign MyDesign_inst(
@@ -0,0 +1,100 @@
+//
+// Clock domain crossing of jtag_interface with TCK_DOMAIN = 1. Internal, instanced by jtag_interface.
+//
+// jtag_memory then runs directly on TCK of the virtual JTAG instead of the TCK synchronized to iMAIN_CLK, so
+//   TCK is no longer limited to a fraction of iMAIN_CLK. Everything it samples from the FPGA design has to be
+//   stable at its Capture-DR, and everything it hands out must only be taken when it is stable:
+//
+//   Inputs:  iDATA, the FIFO status and the timestamp are copied into a hold bank every clock of iMAIN_CLK,
+//            except while Capture-DR is active. Capture-DR lasts one TCK period before jtag_memory samples at
+//            its end, the hold bank is frozen 2 to 3 clocks after it started. So all bits of a register come
+//            from the same clock, up to TCK = 1 / (3 clocks + setup), about 35 MHz with iMAIN_CLK at 120 MHz.
+//   Outputs: The registers of jtag_memory are only written at the end of Update-DR. They are copied to oDATA
+//            when Update-DR is over (again 2 to 3 clocks later) and stay unchanged for at least 4 TCK periods
+//            after that, as the next Update-DR needs at least Select, Capture, Exit1 and Update.
+//
+// The FIFOs already synchronize their toggles and take the data a few clocks after the toggle, they are
+//   connected to the registers of jtag_memory directly.
+//
+// jtag_cdc_tb.v checks this at about 24 and 30 MHz TCK against 120 MHz, with 3 ns of skew on half of every register.
+//   The limit of about 35 MHz is worked out with margin for the setup time, in that testbench reads tear from 50 MHz on.
+//
+
+module jtag_cdc #(
+	parameter REGISTER_SIZE,
+	parameter NUMBER_OF_REGISTERS
+) (
+	input iMAIN_CLK,
+	input iSTATE_CDR,			// TCK domain, straight from the virtual JTAG
+	input iSTATE_UDR,
+	
+	// Main clock domain to jtag_memory
+	input [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] iDATA,
+	input [NUMBER_OF_REGISTERS-1:0][15:0] iFIFO_STATUS,
+	input [NUMBER_OF_REGISTERS-1:0][15:0] iOUTPUT_FIFO_STATUS,
+	input [31:0] iTIMESTAMP,
+	output reg [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] oDATA,
+	output reg [NUMBER_OF_REGISTERS-1:0][15:0] oFIFO_STATUS,
+	output reg [NUMBER_OF_REGISTERS-1:0][15:0] oOUTPUT_FIFO_STATUS,
+	output reg [31:0] oTIMESTAMP,
+	
+	// jtag_memory to the main clock domain
+	input [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] iMEMORY,
+	output reg [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] oMEMORY
+);
+
+wire cdrSync;
+wire udrSync;
+
+reg udrLast = 1'b0;
+
+synchronizer_basic cdr_sync(
+
+	.iCLK(iMAIN_CLK),
+	.iSIGNAL(iSTATE_CDR),
+	.oSYNCHRONIZED(cdrSync)
+	
+);
+
+synchronizer_basic udr_sync(
+
+	.iCLK(iMAIN_CLK),
+	.iSIGNAL(iSTATE_UDR),
+	.oSYNCHRONIZED(udrSync)
+	
+);
+
+integer i;
+initial begin
+	for (i = 0; i < NUMBER_OF_REGISTERS; i = i + 1) begin
+		oDATA[i] = 'b0;
+		oFIFO_STATUS[i] = 'b0;
+		oOUTPUT_FIFO_STATUS[i] = 'b0;
+		oMEMORY[i] = 'b0;
+	end
+	oTIMESTAMP = 'b0;
+end
+
+always @(posedge iMAIN_CLK) begin
+
+	// Frozen while jtag_memory captures
+	if (!cdrSync) begin
+	
+		oDATA <= iDATA;
+		oFIFO_STATUS <= iFIFO_STATUS;
+		oOUTPUT_FIFO_STATUS <= iOUTPUT_FIFO_STATUS;
+		oTIMESTAMP <= iTIMESTAMP;
+	
+	end
+	
+	// Taken once the registers were written
+	udrLast <= udrSync;
+	if (udrLast && !udrSync) begin
+	
+		oMEMORY <= iMEMORY;
+	
+	end
+
+end
+
+endmodule
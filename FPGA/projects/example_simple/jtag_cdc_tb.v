@@ -0,0 +1,236 @@
+//
+// Testbench for jtag_cdc, the clock domain crossing of jtag_interface with TCK_DOMAIN = 1. jtag_memory runs on a
+//   free-running TCK of about 24 and then 30 MHz, its phase walks against the 120 MHz main clock, so Capture-DR and
+//   Update-DR hit every position between two main clocks.
+//
+// Register 0 is {counter, ~counter} of a counter on the main clock. Every read checks that both halves belong
+//   together (coherent) and that the counter was taken at the start of Capture-DR (fresh). Register 1 is written
+//   with {value, ~value}, every change of oMEMORY must be a complete written value. The low halves pass a 3 ns
+//   delay on both paths, like routing skew, so copying a register while it changes would tear it apart.
+//
+// ModelSim: vlog -sv jtag_memory.v jtag_synchronizer_basic.v jtag_cdc.v jtag_cdc_tb.v
+//           vsim -c jtag_cdc_tb -do "run -all"
+//
+// Prints PASSED or FAILED with the number of errors.
+//
+
+`timescale 1ns / 1ps
+
+module jtag_cdc_tb();
+
+localparam REGISTER_SIZE = 32;
+localparam NUMBER_OF_REGISTERS = 2;
+localparam ADDRESS_WIDTH = $clog2(NUMBER_OF_REGISTERS + 1);
+localparam [ADDRESS_WIDTH-1:0] NONE = {ADDRESS_WIDTH{1'b1}};
+localparam SCANS = 500;				// Reads and writes per TCK frequency
+
+reg rCLK = 1'b0;
+reg rTCK = 1'b0;
+reg rTDI = 1'b0;
+reg rCDR = 1'b0;
+reg rSDR = 1'b0;
+reg rUDR = 1'b0;
+reg rUIR = 1'b0;
+reg [ADDRESS_WIDTH*2+3:0] rADDRESS = 'b0;
+reg [15:0] rCOUNTER = 'b0;
+
+real halfPeriod = 20.5;				// TCK, changed by the test
+
+wire wTDO;
+wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] wINPUT;		// Main clock domain
+wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] wHOLD;		// Hold bank of jtag_cdc
+wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] wCAPTURE;		// Skewed, to jtag_memory
+wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] wMEMORY;		// Registers of jtag_memory, TCK domain
+wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] wSKEWED;		// Skewed, to jtag_cdc
+wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] wREGISTER;	// Registers in the main clock domain
+wire [NUMBER_OF_REGISTERS-1:0][15:0] wSTATUS;
+wire [NUMBER_OF_REGISTERS-1:0][15:0] wOUTPUT_STATUS;
+wire [31:0] wTIMESTAMP;
+
+always
+#(1000.0 / 240) rCLK <= !rCLK;
+
+always
+#(halfPeriod) rTCK <= !rTCK;
+
+always @(posedge rCLK) rCOUNTER <= rCOUNTER + 1'b1;
+
+assign wINPUT[0] = { rCOUNTER, ~rCOUNTER };
+assign wINPUT[1] = 'b0;
+
+genvar k;
+generate
+	for (k = 0; k < NUMBER_OF_REGISTERS; k = k + 1) begin : skew
+		assign wCAPTURE[k][31:16] = wHOLD[k][31:16];
+		assign #3 wCAPTURE[k][15:0] = wHOLD[k][15:0];
+		assign wSKEWED[k][31:16] = wMEMORY[k][31:16];
+		assign #3 wSKEWED[k][15:0] = wMEMORY[k][15:0];
+	end
+endgenerate
+
+jtag_cdc #(
+
+	.REGISTER_SIZE(REGISTER_SIZE),
+	.NUMBER_OF_REGISTERS(NUMBER_OF_REGISTERS)
+
+) cdc (
+
+	.iMAIN_CLK(rCLK),
+	.iSTATE_CDR(rCDR),
+	.iSTATE_UDR(rUDR),
+
+	.iDATA(wINPUT),
+	.iFIFO_STATUS('b0),
+	.iOUTPUT_FIFO_STATUS('b0),
+	.iTIMESTAMP('b0),
+	.oDATA(wHOLD),
+	.oFIFO_STATUS(wSTATUS),
+	.oOUTPUT_FIFO_STATUS(wOUTPUT_STATUS),
+	.oTIMESTAMP(wTIMESTAMP),
+
+	.iMEMORY(wSKEWED),
+	.oMEMORY(wREGISTER)
+
+);
+
+jtag_memory #(
+
+	.REGISTER_SIZE(REGISTER_SIZE),
+	.NUMBER_OF_REGISTERS(NUMBER_OF_REGISTERS)
+
+) memory (
+
+	.iADDRESS(rADDRESS),
+	.iTCK(rTCK),
+	.iTDI(rTDI),
+	.iSTATE_CDR(rCDR),
+	.iSTATE_SDR(rSDR),
+	.iSTATE_UDR(rUDR),
+	.iSTATE_UIR(rUIR),
+	.oTDO(wTDO),
+
+	.iDATA(wCAPTURE),
+	.oDATA(wMEMORY),
+
+	.iFIFO_STATUS(wSTATUS),
+	.oFIFO_POP(),
+	.oFIFO_ACK(),
+
+	.iOUTPUT_FIFO_STATUS(wOUTPUT_STATUS),
+	.oOUTPUT_FIFO_PUSH(),
+	.oOUTPUT_FIFO_ACK(),
+
+	.oINTERRUPT(),
+	.iTIMESTAMP(wTIMESTAMP)
+
+);
+
+integer errors = 0;
+reg [15:0] written = 'b0;
+
+// Every change in the main clock domain must be the value written last
+always @(wREGISTER[1]) begin
+	if (wREGISTER[1] !== { written, ~written }) begin
+		$display("ERROR: register 1 changed to %h, %h was written", wREGISTER[1], { written, ~written });
+		errors = errors + 1;
+	end
+end
+
+// The TAP states change right after the rising edge and are taken by jtag_memory at the next one
+task tck;
+begin
+	@(posedge rTCK);
+	#0.5;
+end
+endtask
+
+task instruction(input [2:0] operation, input [ADDRESS_WIDTH-1:0] writeIndex, input [ADDRESS_WIDTH-1:0] readIndex);
+begin
+	rADDRESS = { operation, 1'b1, writeIndex, readIndex };
+	rUIR = 1'b1;
+	tck;
+	rUIR = 1'b0;
+end
+endtask
+
+// Select-DR, Capture-DR, Shift-DR for all bits, Update-DR. start is the counter when Capture-DR began
+task scan(input [REGISTER_SIZE-1:0] send, output [REGISTER_SIZE-1:0] recv, output [15:0] start);
+integer b;
+begin
+	recv = 'b0;
+	tck;
+	rCDR = 1'b1;
+	start = rCOUNTER;
+	tck;
+	rCDR = 1'b0;
+	rSDR = 1'b1;
+	for (b = 0; b < REGISTER_SIZE; b = b + 1) begin
+		recv[b] = wTDO;
+		rTDI = send[b];
+		tck;
+	end
+	rSDR = 1'b0;
+	rUDR = 1'b1;
+	tck;
+	rUDR = 1'b0;
+end
+endtask
+
+task readCounter;
+reg [REGISTER_SIZE-1:0] value;
+reg [15:0] start;
+reg [15:0] age;
+begin
+	scan('b0, value, start);
+	age = value[31:16] - start;
+	if (value[31:16] !== ~value[15:0]) begin
+		$display("ERROR: register 0 torn, read %h", value);
+		errors = errors + 1;
+	end else if (age > 3) begin
+		$display("ERROR: register 0 is %0d clocks off the start of Capture-DR", $signed(age));
+		errors = errors + 1;
+	end
+end
+endtask
+
+task writeRegister(input [15:0] data);
+reg [REGISTER_SIZE-1:0] value;
+reg [15:0] start;
+begin
+	written = data;
+	scan({ data, ~data }, value, start);
+	repeat (4) @(posedge rCLK);
+	if (wREGISTER[1] !== { data, ~data }) begin
+		$display("ERROR: register 1 is %h after the write of %h", wREGISTER[1], { data, ~data });
+		errors = errors + 1;
+	end
+end
+endtask
+
+task run;
+integer i;
+begin
+	instruction(3'd0, NONE, 0);
+	for (i = 0; i < SCANS; i = i + 1) readCounter;
+
+	instruction(3'd0, 1, NONE);
+	for (i = 0; i < SCANS; i = i + 1) writeRegister($random);
+end
+endtask
+
+initial begin
+	repeat (10) @(posedge rCLK);
+
+	// About 24 MHz, 41 ns against 8.33 ns of the main clock
+	run;
+
+	// About 30 MHz
+	halfPeriod = 16.5;
+	run;
+
+	if (errors == 0) $display("PASSED");
+	else $display("FAILED: %0d errors", errors);
+	$finish;
+end
+
+endmodule
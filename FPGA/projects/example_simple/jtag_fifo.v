@@ -0,0 +1,94 @@
+//
+// FIFO behind a streaming register of jtag_interface, see FIFO_REGISTERS and OUTPUT_FIFO_REGISTERS in
+//   jtag_memory.v. Internal, instanced by jtag_interface for every register marked as FIFO.
+//
+// OUTPUT = 0, input register: The FPGA side pushes a value with every clock iWRITE is high. jtag_memory
+//   toggles iPOP every time it captured an entry. When the FIFO is full, new values are dropped and the
+//   flag is set until the status is read.
+//
+// OUTPUT = 1, output register: jtag_memory toggles iWRITE for every value written to the register, the
+//   value is taken from iDATA. The FPGA side takes the entry on oDATA with every clock iPOP is high,
+//   oVALID tells if there is one. Popping an empty FIFO sets the flag until the status is read, this is
+//   a gap in the data seen by the FPGA side.
+//
+// The toggles of jtag_memory (and iACK, toggled every time the status was captured) come from the
+//   synchronized TCK and are synchronized again here.
+//
+// Status: [0] flag (overflow or underrun), [15:1] number of entries (input) or free entries (output)
+//
+// DEPTH must be a power of 2. The entries are kept in logic, keep it small (16 to 256).
+//
+
+module jtag_fifo #(
+	parameter WIDTH,
+	parameter DEPTH = 16,
+	parameter OUTPUT = 0
+) (
+	input iCLK,
+	input iWRITE,
+	input [WIDTH-1:0] iDATA,
+	input iPOP,
+	input iACK,
+
+	output [WIDTH-1:0] oDATA,
+	output oVALID,
+	output [15:0] oSTATUS
+);
+
+localparam POINTER_WIDTH = $clog2(DEPTH);
+localparam LEVEL_WIDTH = $clog2(DEPTH + 1);
+
+reg [WIDTH-1:0] entries [0:DEPTH-1];
+reg [POINTER_WIDTH-1:0] head = 'b0;
+reg [POINTER_WIDTH-1:0] tail = 'b0;
+reg [LEVEL_WIDTH-1:0] level = 'b0;
+reg flag = 1'b0;
+reg [2:0] writeSync = 'b0;
+reg [2:0] popSync = 'b0;
+reg [2:0] ackSync = 'b0;
+
+wire writeRequest;
+wire popRequest;
+wire pop;
+wire push;
+
+// The side connected to jtag_memory toggles, the FPGA side uses one clock wide pulses
+assign writeRequest = OUTPUT ? (writeSync[2] != writeSync[1]) : iWRITE;
+assign popRequest = OUTPUT ? iPOP : (popSync[2] != popSync[1]);
+
+// jtag_memory only pops (input) or writes (output) when the status it captured allows it
+assign pop = popRequest && (level != 0);
+assign push = writeRequest && (level != DEPTH || pop);
+
+assign oDATA = (level != 0) ? entries[head] : 'b0;
+assign oVALID = (level != 0);
+assign oSTATUS = { OUTPUT ? 15'(DEPTH - level) : 15'(level), flag };
+
+always @(posedge iCLK) begin
+
+	writeSync <= { writeSync[1:0], iWRITE };
+	popSync <= { popSync[1:0], iPOP };
+	ackSync <= { ackSync[1:0], iACK };
+
+	if (push) begin
+
+		entries[tail] <= iDATA;
+		tail <= tail + 1'b1;
+
+	end
+
+	if (pop) begin
+
+		head <= head + 1'b1;
+
+	end
+
+	level <= level + push - pop;
+
+	// A problem in the same clock as the status was read is reported by the next status
+	if (ackSync[2] != ackSync[1]) flag <= 1'b0;
+	if (OUTPUT ? (popRequest && !pop) : (writeRequest && !push)) flag <= 1'b1;
+
+end
+
+endmodule
@@ -0,0 +1,401 @@
+//
+// Testbench for the FIFO registers of jtag_memory and jtag_fifo, without the Altera virtual JTAG.
+//   The tasks below drive the synchronized JTAG states like jtag_synchronizer and model the
+//   Arduino side of FPGA.readStream() (read the status, then scan exactly that many entries) and
+//   FPGA.writeStream() (stream writes until the captured status reports a full FIFO). Every value
+//   pushed on one side is also put into a reference queue and compared on the other side.
+//
+// ModelSim: vlog -sv jtag_memory.v jtag_fifo.v jtag_fifo_tb.v
+//           vsim -c jtag_fifo_tb -do "run -all"
+//
+// Prints PASSED after running the stream sequences at 8 and at 4 main clocks per TCK.
+//
+
+`timescale 1ns / 1ps
+
+module jtag_fifo_tb();
+
+localparam REGISTER_SIZE = 16;
+localparam NUMBER_OF_REGISTERS = 3;
+localparam FIFO_DEPTH = 8;
+localparam STREAM = 1;				// Index of the FIFO register
+localparam OUTPUT = 2;				// Index of the output FIFO register
+localparam ADDRESS_WIDTH = $clog2(NUMBER_OF_REGISTERS + 1);
+localparam OP_STATUS = 3'd7;
+localparam [ADDRESS_WIDTH-1:0] NONE = {ADDRESS_WIDTH{1'b1}};
+
+reg rCLK = 1'b0;
+reg rTCK = 1'b0;
+reg rTDI = 1'b0;
+reg rCDR = 1'b0;
+reg rSDR = 1'b0;
+reg rUDR = 1'b0;
+reg rUIR = 1'b0;
+reg [ADDRESS_WIDTH*2+3:0] rADDRESS = 'b0;
+reg rWRITE = 1'b0;
+reg [REGISTER_SIZE-1:0] rSAMPLE = 'b0;
+reg rREAD = 1'b0;
+reg rCONSUME = 1'b0;
+
+wire wTDO;
+wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] wDATA;
+wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] wCAPTURE;
+wire [NUMBER_OF_REGISTERS-1:0][15:0] wSTATUS;
+wire [NUMBER_OF_REGISTERS-1:0] wPOP;
+wire [NUMBER_OF_REGISTERS-1:0] wACK;
+wire [NUMBER_OF_REGISTERS-1:0][15:0] wOUTPUT_STATUS;
+wire [NUMBER_OF_REGISTERS-1:0] wOUTPUT_PUSH;
+wire [NUMBER_OF_REGISTERS-1:0] wOUTPUT_ACK;
+wire [REGISTER_SIZE-1:0] wOUTPUT;
+wire wVALID;
+
+always
+#1 rCLK <= !rCLK;
+
+assign wCAPTURE[0] = 16'h1234;
+assign wCAPTURE[2] = 16'h5678;
+assign wSTATUS[0] = 'b0;
+assign wSTATUS[2] = 'b0;
+assign wOUTPUT_STATUS[0] = 'b0;
+assign wOUTPUT_STATUS[1] = 'b0;
+
+jtag_fifo #(
+
+	.WIDTH(REGISTER_SIZE),
+	.DEPTH(FIFO_DEPTH)
+
+) fifo (
+
+	.iCLK(rCLK),
+	.iWRITE(rWRITE),
+	.iDATA(rSAMPLE),
+	.iPOP(wPOP[STREAM]),
+	.iACK(wACK[STREAM]),
+	.oDATA(wCAPTURE[STREAM]),
+	.oVALID(),
+	.oSTATUS(wSTATUS[STREAM])
+
+);
+
+jtag_fifo #(
+
+	.WIDTH(REGISTER_SIZE),
+	.DEPTH(FIFO_DEPTH),
+	.OUTPUT(1)
+
+) outputFifo (
+
+	.iCLK(rCLK),
+	.iWRITE(wOUTPUT_PUSH[OUTPUT]),
+	.iDATA(wDATA[OUTPUT]),
+	.iPOP(rREAD),
+	.iACK(wOUTPUT_ACK[OUTPUT]),
+	.oDATA(wOUTPUT),
+	.oVALID(wVALID),
+	.oSTATUS(wOUTPUT_STATUS[OUTPUT])
+
+);
+
+jtag_memory #(
+
+	.REGISTER_SIZE(REGISTER_SIZE),
+	.NUMBER_OF_REGISTERS(NUMBER_OF_REGISTERS),
+	.FIFO_REGISTERS(3'b010),
+	.OUTPUT_FIFO_REGISTERS(3'b100)
+
+) memory (
+
+	.iADDRESS(rADDRESS),
+	.iTCK(rTCK),
+	.iTDI(rTDI),
+	.iSTATE_CDR(rCDR),
+	.iSTATE_SDR(rSDR),
+	.iSTATE_UDR(rUDR),
+	.iSTATE_UIR(rUIR),
+	.oTDO(wTDO),
+
+	.iDATA(wCAPTURE),
+	.oDATA(wDATA),
+
+	.iFIFO_STATUS(wSTATUS),
+	.oFIFO_POP(wPOP),
+	.oFIFO_ACK(wACK),
+
+	.iOUTPUT_FIFO_STATUS(wOUTPUT_STATUS),
+	.oOUTPUT_FIFO_PUSH(wOUTPUT_PUSH),
+	.oOUTPUT_FIFO_ACK(wOUTPUT_ACK)
+
+);
+
+// Reference queues
+reg [REGISTER_SIZE-1:0] model [0:1023];
+integer modelHead = 0;
+integer modelTail = 0;
+reg [REGISTER_SIZE-1:0] outputModel [0:1023];
+integer outputHead = 0;
+integer outputTail = 0;
+integer consumeDelay = 0;
+integer errors = 0;
+
+// FPGA side of the output FIFO, takes one entry every 200 clocks while rCONSUME is set
+always @(posedge rCLK) begin
+	rREAD <= 1'b0;
+	if (consumeDelay > 0) consumeDelay <= consumeDelay - 1;
+	if (rCONSUME && wVALID && !rREAD && consumeDelay == 0) begin
+		rREAD <= 1'b1;
+		consumeDelay <= 200;
+		if (outputHead == outputTail) begin
+			$display("ERROR: output entry %h was never written", wOUTPUT);
+			errors = errors + 1;
+		end else begin
+			if (wOUTPUT !== outputModel[outputHead % 1024]) begin
+				$display("ERROR: output entry %0d is %h, expected %h", outputHead, wOUTPUT, outputModel[outputHead % 1024]);
+				errors = errors + 1;
+			end
+			outputHead = outputHead + 1;
+		end
+	end
+end
+
+// One TCK period of 2 * tckHalf main clocks, 8 by default (the default 12 MHz TCK is 10 clocks at 120 MHz)
+integer tckHalf = 4;
+
+task tck;
+begin
+	repeat (tckHalf) @(posedge rCLK);
+	rTCK <= 1'b1;
+	repeat (tckHalf) @(posedge rCLK);
+	rTCK <= 1'b0;
+end
+endtask
+
+task instruction(input [2:0] operation, input [ADDRESS_WIDTH-1:0] writeIndex, input [ADDRESS_WIDTH-1:0] readIndex);
+begin
+	rADDRESS = { operation, 1'b1, writeIndex, readIndex };
+	rUIR = 1'b1;
+	tck;
+	rUIR = 1'b0;
+end
+endtask
+
+// Capture-DR, Shift-DR for all bits, Update-DR
+task scan(input [REGISTER_SIZE-1:0] send, output [REGISTER_SIZE-1:0] recv);
+integer b;
+begin
+	recv = 'b0;
+	rCDR = 1'b1;
+	tck;
+	rCDR = 1'b0;
+	rSDR = 1'b1;
+	for (b = 0; b < REGISTER_SIZE; b = b + 1) begin
+		recv[b] = wTDO;
+		rTDI = send[b];
+		tck;
+	end
+	rSDR = 1'b0;
+	rUDR = 1'b1;
+	tck;
+	rUDR = 1'b0;
+end
+endtask
+
+task push(input [REGISTER_SIZE-1:0] value);
+begin
+	@(posedge rCLK);
+	rSAMPLE <= value;
+	rWRITE <= 1'b1;
+	@(posedge rCLK);
+	rWRITE <= 1'b0;
+	if (modelTail - modelHead < FIFO_DEPTH) begin
+		model[modelTail % 1024] = value;
+		modelTail = modelTail + 1;
+	end
+end
+endtask
+
+task readStatus(output integer level, output overflow);
+reg [REGISTER_SIZE-1:0] status;
+begin
+	instruction(OP_STATUS, NONE, STREAM);
+	scan('b0, status);
+	level = status[15:1];
+	overflow = status[0];
+end
+endtask
+
+// Same sequence as FPGA.readStream()
+task readStream(output integer count, output overflow);
+reg [REGISTER_SIZE-1:0] value;
+integer i;
+begin
+	readStatus(count, overflow);
+	if (count > 0) begin
+		instruction(3'd0, NONE, STREAM);
+		for (i = 0; i < count; i = i + 1) begin
+			scan('b0, value);
+			if (modelHead == modelTail) begin
+				$display("ERROR: entry %h read, but none was pushed", value);
+				errors = errors + 1;
+			end else begin
+				if (value !== model[modelHead % 1024]) begin
+					$display("ERROR: entry %0d is %h, expected %h", modelHead, value, model[modelHead % 1024]);
+					errors = errors + 1;
+				end
+				modelHead = modelHead + 1;
+			end
+		end
+	end
+end
+endtask
+
+// Same sequence as FPGA.writeStream(), stops at the first value that was not taken. The value is queued
+// before the scan, the consumer may already take it in the clocks after Update-DR. Without a consumer
+// (checkFree), the status of every scan must already count the value pushed by the scan before.
+task writeStream(input [REGISTER_SIZE-1:0] first, input integer count, input checkFree, output integer accepted,
+	output underrun);
+reg [REGISTER_SIZE-1:0] status;
+reg full;
+begin
+	accepted = 0;
+	underrun = 1'b0;
+	full = 1'b0;
+	instruction(OP_STATUS, OUTPUT, NONE);
+	while (accepted < count && !full) begin
+		outputModel[outputTail % 1024] = first + accepted;
+		outputTail = outputTail + 1;
+		scan(first + accepted, status);
+		underrun = underrun | status[0];
+		full = (status[15:1] == 0);
+		if (checkFree && status[15:1] != FIFO_DEPTH - (outputTail - 1 - outputHead)) begin
+			$display("ERROR: free output entries are %0d before value %0d, expected %0d", status[15:1], accepted,
+				FIFO_DEPTH - (outputTail - 1 - outputHead));
+			errors = errors + 1;
+		end
+		if (full) outputTail = outputTail - 1;
+		else accepted = accepted + 1;
+	end
+end
+endtask
+
+task check(input integer value, input integer expected, input [8*32-1:0] what);
+begin
+	if (value !== expected) begin
+		$display("ERROR: %0s is %0d, expected %0d", what, value, expected);
+		errors = errors + 1;
+	end
+end
+endtask
+
+// A lost value stops the waits for the consumer, the whole run takes about 340 us
+initial begin
+	#2000000;
+	$display("FAILED: timeout, %0d errors", errors);
+	$finish;
+end
+
+integer level;
+integer count;
+integer total;
+integer p;
+integer pass;
+reg overflow;
+reg [REGISTER_SIZE-1:0] value;
+
+initial begin
+	repeat (10) @(posedge rCLK);
+
+	// Empty FIFO: reads 0 and nothing is taken out
+	readStatus(level, overflow);
+	check(level, 0, "initial level");
+	check(overflow, 0, "initial overflow");
+	instruction(3'd0, NONE, STREAM);
+	scan('b0, value);
+	check(value, 0, "empty read");
+	push(16'hA001);
+	readStatus(level, overflow);
+	check(level, 1, "level right after one push");
+	readStream(count, overflow);
+	check(count, 1, "entries read");
+
+	// Normal registers are not affected
+	instruction(3'd0, NONE, 0);
+	scan('b0, value);
+	check(value, 16'h1234, "register 0");
+
+	// Everything below at 8 and at 4 main clocks per TCK, the second one leaves the synchronizers of
+	// jtag_fifo about half the time between two scans
+	for (pass = 0; pass < 2; pass = pass + 1) begin
+		tckHalf = (pass == 0) ? 4 : 2;
+
+		// Overflow: the first FIFO_DEPTH values are kept, the flag is cleared by the status read
+		for (p = 0; p < FIFO_DEPTH + 3; p = p + 1) push(16'hB000 + p);
+		repeat (4) @(posedge rCLK);
+		readStream(count, overflow);
+		check(count, FIFO_DEPTH, "entries after overflow");
+		check(overflow, 1, "overflow flag");
+		readStatus(level, overflow);
+		check(level, 0, "level after draining");
+		check(overflow, 0, "overflow flag after status read");
+
+		// Concurrent: bursts of 5 samples while the host drains the FIFO, nothing may be lost
+		total = 0;
+		fork
+			begin
+				for (p = 0; p < 200; p = p + 1) begin
+					push(16'hC000 + p);
+					if (p % 5 == 4) repeat (1500) @(posedge rCLK);
+				end
+			end
+			begin
+				while (total < 200) begin
+					readStream(count, overflow);
+					if (overflow) begin
+						$display("ERROR: overflow while draining");
+						errors = errors + 1;
+					end
+					total = total + count;
+				end
+			end
+		join
+		check(modelTail - modelHead, 0, "entries left in the model");
+
+		// Output FIFO: without a consumer only FIFO_DEPTH values are taken
+		writeStream(16'hD000, FIFO_DEPTH + 4, 1'b1, count, overflow);
+		check(count, FIFO_DEPTH, "output values taken");
+		check(overflow, 0, "initial underrun");
+		rCONSUME = 1'b1;
+		wait (outputHead == outputTail);
+		repeat (250) @(posedge rCLK);
+		rCONSUME = 1'b0;
+
+		// Popping the empty FIFO is a gap, reported by the next status
+		@(posedge rCLK);
+		rREAD <= 1'b1;
+		@(posedge rCLK);
+		rREAD <= 1'b0;
+		instruction(OP_STATUS, NONE, OUTPUT);
+		scan('b0, value);
+		check(value[15:1], FIFO_DEPTH, "free output entries");
+		check(value[0], 1, "underrun flag");
+
+		// Back-pressure: the host writes faster than the FPGA side consumes, every value arrives once
+		rCONSUME = 1'b1;
+		total = 0;
+		while (total < 100) begin
+			writeStream(16'hE000 + total, 100 - total, 1'b0, count, overflow);
+			if (overflow) begin
+				$display("ERROR: output FIFO ran empty while the host was writing");
+				errors = errors + 1;
+			end
+			total = total + count;
+		end
+		wait (outputHead == outputTail);
+		rCONSUME = 1'b0;
+	end
+
+	if (errors == 0) $display("PASSED");
+	else $display("FAILED: %0d errors", errors);
+	$finish;
+end
+
+endmodule
@@ -1,14 +1,34 @@
 
 module jtag_interface #(
 	parameter REGISTER_SIZE,
-	parameter NUMBER_OF_REGISTERS
+	parameter NUMBER_OF_REGISTERS,
+	parameter [NUMBER_OF_REGISTERS*8-1:0] REGISTER_WIDTHS = 'b0,		// Optional, see jtag_memory.v
+	parameter [NUMBER_OF_REGISTERS*2-1:0] REGISTER_DIRECTIONS = 'b0,
+	parameter [31:0] BUILD_HASH = 'b0,
+	parameter INSTANCE = -1,			// Instance number for _FPGA(instance), -1 lets Quartus count them up
+	parameter [NUMBER_OF_REGISTERS-1:0] FIFO_REGISTERS = 'b0,	// Input registers backed by a FIFO
+	parameter [NUMBER_OF_REGISTERS-1:0] OUTPUT_FIFO_REGISTERS = 'b0,	// Output registers backed by a FIFO
+	parameter FIFO_DEPTH = 16,
+	parameter CHANGE_FLAGS = 0,			// 1 for FPGA.readChanged() and the change interrupt, see jtag_memory.v
+	parameter [NUMBER_OF_REGISTERS-1:0] THRESHOLD_REGISTERS = 'b0,
+	parameter [NUMBER_OF_REGISTERS-1:0] PROBE_REGISTERS = 'b0,	// Input registers fed by latency_probe.v
+	parameter SNAPSHOT = 0,				// 1 for the shadow bank of FPGA.snapshot()
+	parameter TIMESTAMP_WIDTH = 0,		// Up to 32, counts iMAIN_CLK, see jtag_memory.v
+	parameter MONITOR = 0,				// Scan and idle counters on oMONITOR, see jtag_monitor.v (undercounts with fast TCK)
+	parameter TCK_DOMAIN = 0,			// Run jtag_memory on TCK for faster TCK, see jtag_cdc.v
+	parameter BANKS = 1					// Splits the registers into banks, see jtag_memory.v
 ) (
 	input iMAIN_CLK,
 	input [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] iDATA,
-	output [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] oDATA
+	output [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] oDATA,
+	input [NUMBER_OF_REGISTERS-1:0] iFIFO_WRITE,		// Pushes iDATA into the FIFO registers, unused otherwise
+	input [NUMBER_OF_REGISTERS-1:0] iFIFO_READ,			// Takes oDATA out of the output FIFO registers
+	output [NUMBER_OF_REGISTERS-1:0] oFIFO_VALID,		// oDATA of the output FIFO registers holds an entry
+	output oINTERRUPT,			// Connect to oSAM_INT for FPGA.attachChangeInterrupt()
+	output [7:0][31:0] oMONITOR			// Connect to input registers to read them, 0 without MONITOR
 );
 
-localparam ADDRESS_WIDTH = $clog2(NUMBER_OF_REGISTERS + 1);
+localparam ADDRESS_WIDTH = $clog2(NUMBER_OF_REGISTERS / BANKS + 1);
 
 wire tdi;
 wire tdo;
@@ -16,19 +36,50 @@ wire tck;
 wire cdr;
 wire sdr;
 wire udr;
+wire uir;
 
 wire tdiSync;
-wire tdoSync;
 wire tckSync;
 wire cdrSync;
 wire sdrSync;
 wire udrSync;
+wire uirSync;
+wire tdoSynchronizer;
 
-wire [ADDRESS_WIDTH*2:0] address;
+// Signals of jtag_memory, synchronized to iMAIN_CLK or straight from the virtual JTAG with TCK_DOMAIN
+wire memoryTck;
+wire memoryTdi;
+wire memoryCdr;
+wire memorySdr;
+wire memoryUdr;
+wire memoryUir;
+wire memoryTdo;
+wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] memoryInput;
+wire [NUMBER_OF_REGISTERS-1:0][15:0] memoryFifoStatus;
+wire [NUMBER_OF_REGISTERS-1:0][15:0] memoryOutputStatus;
+wire [31:0] memoryTimestamp;
+wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] registerData;		// Registers of jtag_memory in the main clock domain
+
+wire [ADDRESS_WIDTH*2+3:0] address;
+
+wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] captureData;
+wire [NUMBER_OF_REGISTERS-1:0][15:0] fifoStatus;
+wire [NUMBER_OF_REGISTERS-1:0] fifoPop;
+wire [NUMBER_OF_REGISTERS-1:0] fifoAck;
+wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] memoryData;
+wire [NUMBER_OF_REGISTERS-1:0][15:0] outputStatus;
+wire [NUMBER_OF_REGISTERS-1:0] outputPush;
+wire [NUMBER_OF_REGISTERS-1:0] outputAck;
+wire interrupt;
+
+reg interruptSync = 1'b0;
+reg [31:0] timestamp = 'b0;
 
 sld_virtual_jtag #(
 
-	.sld_ir_width(ADDRESS_WIDTH*2 + 1)
+	.sld_ir_width(ADDRESS_WIDTH*2 + 4),
+	.sld_auto_instance_index(INSTANCE < 0 ? "YES" : "NO"),
+	.sld_instance_index(INSTANCE < 0 ? 0 : INSTANCE)
 	
 ) jtag (
 
@@ -38,7 +89,8 @@ sld_virtual_jtag #(
 	.ir_in(address),
 	.virtual_state_cdr(cdr),
 	.virtual_state_sdr(sdr),
-	.virtual_state_udr(udr)
+	.virtual_state_udr(udr),
+	.virtual_state_uir(uir)
 	
 );
 
@@ -51,34 +103,213 @@ jtag_synchronizer jtag_sync(
 	.iSTATE_CDR(cdr),
 	.iSTATE_SDR(sdr),
 	.iSTATE_UDR(udr),
-	.oTDO(tdo),
+	.oTDO(tdoSynchronizer),
 	
 	.oTDI(tdiSync),
 	.oTCK(tckSync),
 	.oSTATE_CDR(cdrSync),
 	.oSTATE_SDR(sdrSync),
 	.oSTATE_UDR(udrSync),
-	.iTDO(tdoSync)
+	.iTDO(memoryTdo)
+	
+);
+
+// Update-IR is not part of jtag_synchronizer, it gets the same two-stage synchronizer here
+synchronizer_basic uir_sync(
+
+	.iCLK(iMAIN_CLK),
+	.iSIGNAL(uir),
+	.oSYNCHRONIZED(uirSync)
 	
 );
 
+generate
+	if (TCK_DOMAIN) begin : tck_domain
+	
+		assign memoryTck = tck;
+		assign memoryTdi = tdi;
+		assign memoryCdr = cdr;
+		assign memorySdr = sdr;
+		assign memoryUdr = udr;
+		assign memoryUir = uir;
+		assign tdo = memoryTdo;
+	
+		jtag_cdc #(
+		
+			.REGISTER_SIZE(REGISTER_SIZE),
+			.NUMBER_OF_REGISTERS(NUMBER_OF_REGISTERS)
+		
+		) cdc (
+		
+			.iMAIN_CLK(iMAIN_CLK),
+			.iSTATE_CDR(cdr),
+			.iSTATE_UDR(udr),
+			
+			.iDATA(captureData),
+			.iFIFO_STATUS(fifoStatus),
+			.iOUTPUT_FIFO_STATUS(outputStatus),
+			.iTIMESTAMP(timestamp),
+			.oDATA(memoryInput),
+			.oFIFO_STATUS(memoryFifoStatus),
+			.oOUTPUT_FIFO_STATUS(memoryOutputStatus),
+			.oTIMESTAMP(memoryTimestamp),
+			
+			.iMEMORY(memoryData),
+			.oMEMORY(registerData)
+		
+		);
+	
+	end else begin
+	
+		assign memoryTck = tckSync;
+		assign memoryTdi = tdiSync;
+		assign memoryCdr = cdrSync;
+		assign memorySdr = sdrSync;
+		assign memoryUdr = udrSync;
+		assign memoryUir = uirSync;
+		assign tdo = tdoSynchronizer;
+		
+		assign memoryInput = captureData;
+		assign memoryFifoStatus = fifoStatus;
+		assign memoryOutputStatus = outputStatus;
+		assign memoryTimestamp = timestamp;
+		assign registerData = memoryData;
+	
+	end
+endgenerate
+
+// FIFO registers capture the oldest entry of their FIFO, all others capture iDATA directly
+genvar k;
+generate
+	for (k = 0; k < NUMBER_OF_REGISTERS; k = k + 1) begin : register
+		if (FIFO_REGISTERS[k]) begin
+		
+			jtag_fifo #(
+			
+				.WIDTH(REGISTER_SIZE),
+				.DEPTH(FIFO_DEPTH)
+			
+			) fifo (
+			
+				.iCLK(iMAIN_CLK),
+				.iWRITE(iFIFO_WRITE[k]),
+				.iDATA(iDATA[k]),
+				.iPOP(fifoPop[k]),
+				.iACK(fifoAck[k]),
+				.oDATA(captureData[k]),
+				.oVALID(),
+				.oSTATUS(fifoStatus[k])
+			
+			);
+		
+		end else begin
+		
+			assign captureData[k] = iDATA[k];
+			assign fifoStatus[k] = 'b0;
+		
+		end
+		
+		if (OUTPUT_FIFO_REGISTERS[k]) begin
+		
+			jtag_fifo #(
+			
+				.WIDTH(REGISTER_SIZE),
+				.DEPTH(FIFO_DEPTH),
+				.OUTPUT(1)
+			
+			) outputFifo (
+			
+				.iCLK(iMAIN_CLK),
+				.iWRITE(outputPush[k]),
+				.iDATA(memoryData[k]),
+				.iPOP(iFIFO_READ[k]),
+				.iACK(outputAck[k]),
+				.oDATA(oDATA[k]),
+				.oVALID(oFIFO_VALID[k]),
+				.oSTATUS(outputStatus[k])
+			
+			);
+		
+		end else begin
+		
+			assign oDATA[k] = registerData[k];
+			assign oFIFO_VALID[k] = 1'b0;
+			assign outputStatus[k] = 'b0;
+		
+		end
+	end
+endgenerate
+
+generate
+	if (MONITOR) begin : monitor
+	
+		jtag_monitor bus_monitor(
+		
+			.iMAIN_CLK(iMAIN_CLK),
+			.iTCK(tckSync),
+			.iSTATE_CDR(cdrSync),
+			.iSTATE_SDR(sdrSync),
+			.iSTATE_UDR(udrSync),
+			.oMONITOR(oMONITOR)
+		
+		);
+	
+	end else begin
+	
+		assign oMONITOR = 'b0;
+	
+	end
+endgenerate
+
+// The interrupt is combined from both clock domains, register it so the Arduino never sees a glitch
+always @(posedge iMAIN_CLK) interruptSync <= interrupt;
+assign oINTERRUPT = interruptSync;
+
+// Free-running, sampled by jtag_memory like iDATA
+always @(posedge iMAIN_CLK) begin
+	if (TIMESTAMP_WIDTH != 0) timestamp <= timestamp + 1'b1;
+end
+
 jtag_memory #(
 
 	.REGISTER_SIZE(REGISTER_SIZE),
-	.NUMBER_OF_REGISTERS(NUMBER_OF_REGISTERS)
+	.NUMBER_OF_REGISTERS(NUMBER_OF_REGISTERS),
+	.REGISTER_WIDTHS(REGISTER_WIDTHS),
+	.REGISTER_DIRECTIONS(REGISTER_DIRECTIONS),
+	.BUILD_HASH(BUILD_HASH),
+	.FIFO_REGISTERS(FIFO_REGISTERS),
+	.OUTPUT_FIFO_REGISTERS(OUTPUT_FIFO_REGISTERS),
+	.CHANGE_FLAGS(CHANGE_FLAGS),
+	.THRESHOLD_REGISTERS(THRESHOLD_REGISTERS),
+	.PROBE_REGISTERS(PROBE_REGISTERS),
+	.SNAPSHOT(SNAPSHOT),
+	.TIMESTAMP_WIDTH(TIMESTAMP_WIDTH),
+	.BANKS(BANKS)
 
 ) memory (
 	
 	.iADDRESS(address),
-	.iTCK(tckSync),
-	.iTDI(tdiSync),
-	.iSTATE_CDR(cdrSync),
-	.iSTATE_SDR(sdrSync),
-	.iSTATE_UDR(udrSync),
-	.oTDO(tdoSync),
-	
-	.iDATA(iDATA),
-	.oDATA(oDATA)
+	.iTCK(memoryTck),
+	.iTDI(memoryTdi),
+	.iSTATE_CDR(memoryCdr),
+	.iSTATE_SDR(memorySdr),
+	.iSTATE_UDR(memoryUdr),
+	.iSTATE_UIR(memoryUir),
+	.oTDO(memoryTdo),
+	
+	.iDATA(memoryInput),
+	.oDATA(memoryData),
+	
+	.iFIFO_STATUS(memoryFifoStatus),
+	.oFIFO_POP(fifoPop),
+	.oFIFO_ACK(fifoAck),
+	
+	.iOUTPUT_FIFO_STATUS(memoryOutputStatus),
+	.oOUTPUT_FIFO_PUSH(outputPush),
+	.oOUTPUT_FIFO_ACK(outputAck),
+	
+	.oINTERRUPT(interrupt),
+	.iTIMESTAMP(memoryTimestamp)
 	
 );
 
@@ -16,6 +16,8 @@
 // This entire protocol works like a shift register. The Altera Virtual JTAG instance provides us with an 
 //   address register, a data out pin and three control signals. These are synchronized with the main clock to prevent
 //   undefined behaviour and are then fed into this memory block. 
+//   With TCK_DOMAIN = 1 in jtag_interface they are not synchronized, this block then runs on TCK and jtag_cdc.v
+//   hands the registers over to the main clock.
 //
 // When transaction starts, first the address is shifted bit-by-bit into the Altera Virtual address register 
 //   (not handled by us). This has a fixed bit-width, defined by the parameters provided to this FPGA module.
@@ -25,28 +27,122 @@
 //   by the address. This means you don't need to care about signals changing during transmission. Basically an 
 //   instantaneous snapshot is taken before transmitting.
 //
-// When both write and read indices are -1 at the same time, 
-//   a 16-bit identifier value is shifted out, containing the register width (high byte) 
-//   and the number of usable registers (low byte). It is used in the Arduino program at startup to check
-//   for bit width mismatches, preventing configuration mistakes.
+// When both write and read indices are -1 at the same time, a descriptor of the register map is shifted
+//   out. It is read by the Arduino program at startup, which either checks it against the configuration
+//   given to FPGA.begin(width, count) or configures itself with FPGA.begin(). LSB first:
+//
+//      [7:0]      number of usable registers, per bank with BANKS > 1
+//      [15:8]     register size (width of the widest register)
+//      [23:16]    version of this module (4)
+//      [31:24]    feature flags (bit 0: burst mode, bit 1: register width table, bit 2: atomic operations,
+//                 bit 3: FIFO registers, bit 4: output FIFO registers, bit 5: change flags, bit 6: interrupt)
+//      [63:32]    BUILD_HASH, any value identifying the bitstream (e.g. the hash of a generated register map)
+//      [79:64]    more feature flags (bit 0: snapshot, bit 1: timestamps, bit 2: register file of jtag_ram.v,
+//                 bit 3: banks)
+//      [87:80]    TIMESTAMP_WIDTH
+//      [95:88]    BANKS
+//      then one 16-bit entry per register of all banks: [7:0] width, [8] input used, [9] output used, [10] FIFO,
+//                 [11] output FIFO, [12] threshold register, [13] latency probe (PROBE_REGISTERS), [15:14] reserved
+//
+//   Older versions only had the lower 16 bits (version 0), the 32 bits followed by one width byte per
+//   register (version 2) or no bits 64 to 95 (version 3).
+//
+// Registers can have different widths: REGISTER_WIDTHS contains one byte per register (register 0 in the
+//   lowest byte), 0 means REGISTER_SIZE. REGISTER_SIZE must be the widest one. Every transfer shifts
+//   exactly as many bits as the wider of the two addressed registers, so a 1-bit flag in a 64-bit design 
+//   only costs 1 data clock. REGISTER_DIRECTIONS optionally marks which registers are connected, two bits 
+//   per register (bit 0: input, bit 1: output), 0 means both.
+//
+// FIFO registers: Input registers marked in FIFO_REGISTERS (one bit per register) are streams. jtag_interface
+//   puts a jtag_fifo of FIFO_DEPTH entries in front of them, written with iFIFO_WRITE. Every Capture-DR of such a
+//   register takes the oldest entry out of the FIFO, so samples arriving faster than the Arduino program polls
+//   are not lost. Reading the register with operation 111 (see below) captures the status of the FIFO instead:
+//   [0] overflow (cleared by this read), [15:1] number of entries. The Arduino library reads the status first
+//   and then exactly that many entries in one chain of data register scans, see FPGA.readStream(). The status
+//   is cut to the width of the register, 8-bit FIFO registers can have up to 64 entries.
+//
+// Output FIFO registers: Output registers marked in OUTPUT_FIFO_REGISTERS push every value written to them into
+//   a jtag_fifo, the FPGA side takes the entries with iFIFO_READ at its own pace (oFIFO_VALID tells if there is
+//   one). Writing with operation 111 is a stream write: the status of the FIFO ([0] the FPGA side found it empty
+//   since the last status, [15:1] free entries) is shifted out while the value is shifted in, and the value is only
+//   pushed if the captured status had space. The Arduino program therefore knows after every scan whether its value
+//   was taken, see FPGA.writeStream(). Reading the register with operation 111 captures the same status.
+//
+// Change flags: Off by default, with CHANGE_FLAGS = 1 the module keeps the value of every input register as it
+//   was last captured. Operation 110 with both indices -1 shifts out one bit per register (register 0 first), set
+//   if the register differs from the value the Arduino program read last, or if its FIFO is not empty. Reading a
+//   register clears its bit, so polling many mostly quiet registers costs one short scan plus the registers that
+//   changed, see FPGA.readChanged(). The last read values are a copy of all input registers, compared with the
+//   inputs in every clock, which is why it has to be enabled.
+//
+// Threshold registers: For registers marked in THRESHOLD_REGISTERS the change flag is only set when the input
+//   crosses the value of the output register with the same index (unsigned), compared to the value read last.
+//   So a limit switch or level alarm needs no extra logic, the Arduino program writes the threshold. Needs
+//   CHANGE_FLAGS = 1.
+//
+// Interrupt: oINTERRUPT is high while any change flag in the interrupt mask is set. The mask is the vector shifted
+//   in during the change flag scan (operation 110), it takes effect at Update-DR. Route it to oSAM_INT in
+//   MKRVIDOR4000_top.v, the Arduino library reads the flagged registers from its interrupt handler, see
+//   FPGA.attachChangeInterrupt(). Needs CHANGE_FLAGS = 1.
+//
+// Snapshot: Off by default, with SNAPSHOT = 1 operation 101 with both indices -1 copies all inputs into a shadow
+//   bank in the same clock of Capture-DR. Reads with operation 101 capture the register from the shadow bank
+//   instead of the input, so registers read one by one, in a burst or over several loop iterations still come
+//   from the same instant, until the next snapshot. FIFO registers are copied without taking their entry, and
+//   reading the shadow bank does not touch the change flags. See FPGA.snapshot(). The shadow bank is one more copy
+//   of all input registers (and of the timestamp), which is why it has to be enabled.
+//
+// Timestamps: With TIMESTAMP_WIDTH > 0 every Capture-DR also latches iTIMESTAMP, a free-running counter of the
+//   FPGA (jtag_interface counts iMAIN_CLK). After the bits of the register the scan continues with the
+//   timestamp, LSB first, so a read that shifts TIMESTAMP_WIDTH bits more tells when the value was sampled, at
+//   no extra scan. Shorter scans are not affected. Reads of the shadow bank return the time of the snapshot,
+//   FIFO entries the time they were read. Both indices -1 with the single access bit cleared shift out
+//   only the timestamp, see FPGA.readTimestamp().
+//
+// Banks: With BANKS > 1 the NUMBER_OF_REGISTERS registers are split into banks of NUMBER_OF_REGISTERS / BANKS
+//   registers, NUMBER_OF_REGISTERS must be a multiple of BANKS. The instruction only holds the indices inside the
+//   selected bank, so the instruction scan stays as short as for a single bank, while the total number of registers
+//   grows. Operation 001 with both indices -1 shifts the 8-bit bank number in (and the old one out), it is taken at
+//   Update-DR and kept until the next bank select. Bank 0 is meant for the registers used all the time, it is
+//   selected after startup. Change flags and the interrupt only cover bank 0, everything else works the same in
+//   every bank. See FPGA.selectBank().
 //
 // The address in the instruction register contains both the write and read index. Its width depends on the
-//   configuration. The total number of registers is used -> usable registers + 1.
+//   configuration. The total number of registers is used -> usable registers (of one bank) + 1.
 //
 //   addressWidth = ceil(log2(TOTAL_NUMBER_OF_REGISTERS + 1))
 // 
 // Example used for demonstration below: 
 //   NUMBER_OF_USABLE_REGISTERS = 16       ->      addressWidth = 5
 //
-//   In this example the address would be 11 bits: addressWidth * 2 + 1(reserved).
+//   In this example the address would be 14 bits: 3(operation) + 1(single access) + addressWidth * 2.
 //
-//                                  1  00000  00000
-//                                  ^    ^      ^ 
-//                                 /     |       \
-//                 Must always be 1      |       Index to read from
-//                                       |
+//                             000  1  00000  00000
+//                              ^   ^    ^      ^ 
+//                             /   /     |       \
+//                    Operation   /      |       Index to read from
+//                      Single access    |
 //                              Index to write to
 //
+// Operation: Decides how the shifted in value is applied to the write register at Update-DR. The FPGA
+//   combines it with the current content in the same clock, so there is no window between reading and
+//   writing the register in which the Arduino program (or one of its interrupts) could interfere.
+//
+//      000  write, the value replaces the register
+//      001  set, register | value
+//      010  clear, register & ~value
+//      011  toggle, register ^ value
+//      100  add, register + value (wraps at the register width)
+//      101  on a read: capture from the shadow bank, with both indices -1: take a snapshot
+//      111  on a read of a FIFO register: capture the status instead of an entry
+//           on a write of an output FIFO register: stream write, see above
+//      110  with both indices -1: shift out the change flags instead of the descriptor
+//
+// Burst mode: When the highest bit is 0, every Update-DR advances both indices by one (unless they are -1), 
+//   so the next register is accessed without shifting a new address. The Arduino library chains several
+//   data register scans (Exit1 -> Update -> Select -> Capture -> Shift) and transfers a whole block of registers
+//   for the cost of one address. The indices return to the start when a new address is shifted (Update-IR).
+//
 // When the total number of registers is not a power of 2 there are free register addresses: For this reason
 //   the number of registers available by default seem so off (3, 7, 15, 31, ...). These are the most memory
 //   and speed efficient. More registers mean a wider address, which is more data to transmit, which is slower.
@@ -54,32 +150,105 @@
 //
 // The parameters are by default limited to 255 registers with 64 bits each. However, this restriction is only
 //   on the Arduino side. The FPGA side can take much more than that, but you would have to adapt the 
-//   Arduino library.
+//   Arduino library. Banks (see above) give more registers with the same instruction, and for large tables
+//   jtag_register_file.v keeps up to 65535 words in block RAM.
 //
-// For now, only one JTAG_Interface can be instanced in one FPGA program. (Only the first one is chosen 
-//   for transaction). In the future, it might be possible to use multiple instances and reference them
-//   using their ID, but it would be more complicated. Let me know if you would be interested in this feature!
+// Several JTAG_Interfaces can be instanced in one FPGA program, e.g. a small one for control registers
+//   and a wide one for bulk data. Each one is a separate slave of the virtual JTAG hub, set the INSTANCE
+//   parameter of jtag_interface and access it with _FPGA(instance) on the Arduino side. The global FPGA
+//   object uses instance 0. Each instance keeps its own address until its next instruction, so
+//   switching between instances costs one instruction scan.
 //
 
 module jtag_memory #(
 	parameter REGISTER_SIZE,
-	parameter NUMBER_OF_REGISTERS
+	parameter NUMBER_OF_REGISTERS,
+	parameter [NUMBER_OF_REGISTERS*8-1:0] REGISTER_WIDTHS = 'b0,
+	parameter [NUMBER_OF_REGISTERS*2-1:0] REGISTER_DIRECTIONS = 'b0,
+	parameter [31:0] BUILD_HASH = 'b0,
+	parameter [NUMBER_OF_REGISTERS-1:0] FIFO_REGISTERS = 'b0,
+	parameter [NUMBER_OF_REGISTERS-1:0] OUTPUT_FIFO_REGISTERS = 'b0,
+	parameter CHANGE_FLAGS = 0,
+	parameter [NUMBER_OF_REGISTERS-1:0] THRESHOLD_REGISTERS = 'b0,
+	parameter [NUMBER_OF_REGISTERS-1:0] PROBE_REGISTERS = 'b0,
+	parameter SNAPSHOT = 0,
+	parameter TIMESTAMP_WIDTH = 0,
+	parameter BANKS = 1
 ) (
 	input iTCK,
 	input iTDI,
 	input iSTATE_SDR,
 	input iSTATE_CDR,
 	input iSTATE_UDR,
+	input iSTATE_UIR,
 	output oTDO,
 	
-	input [ADDRESS_WIDTH*2:0] iADDRESS,
+	input [ADDRESS_WIDTH*2+3:0] iADDRESS,
 	input [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] iDATA,
-	output [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] oDATA
+	output [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] oDATA,
+	
+	input [NUMBER_OF_REGISTERS-1:0][15:0] iFIFO_STATUS,
+	output [NUMBER_OF_REGISTERS-1:0] oFIFO_POP,		// Toggled for every entry taken
+	output [NUMBER_OF_REGISTERS-1:0] oFIFO_ACK,		// Toggled for every status read
+	
+	input [NUMBER_OF_REGISTERS-1:0][15:0] iOUTPUT_FIFO_STATUS,
+	output [NUMBER_OF_REGISTERS-1:0] oOUTPUT_FIFO_PUSH,	// Toggled for every value written
+	output [NUMBER_OF_REGISTERS-1:0] oOUTPUT_FIFO_ACK,	// Toggled for every status read
+	
+	output oINTERRUPT,
+	
+	input [31:0] iTIMESTAMP		// Only the lower TIMESTAMP_WIDTH bits are used
 );
 
-localparam NUMBER_OF_ALL_REGISTERS = NUMBER_OF_REGISTERS + 1;
-localparam ADDRESS_WIDTH = $clog2(NUMBER_OF_ALL_REGISTERS);
-localparam IDREG_SIZE = 16;
+localparam BANK_SIZE = NUMBER_OF_REGISTERS / BANKS;		// Registers addressed by the instruction
+localparam ADDRESS_WIDTH = $clog2(BANK_SIZE + 1);
+localparam INDEX_WIDTH = $clog2(NUMBER_OF_REGISTERS + 1);		// Index over all banks
+localparam IDREG_SIZE = 96;
+localparam VERSION = 4;
+// Bit 0: burst mode, bit 1: width table, bit 2: atomic operations, bit 3/4: FIFOs, bit 5: change flags,
+// bit 6: interrupt
+localparam [7:0] FEATURES = { 1'b0, CHANGE_FLAGS != 0, CHANGE_FLAGS != 0, 5'b11111 };
+// Bit 0: snapshot, bit 1: timestamps, bit 3: banks
+localparam [15:0] EXTENDED_FEATURES = { 12'b0, BANKS > 1, 1'b0, TIMESTAMP_WIDTH != 0, SNAPSHOT != 0 };
+
+localparam [31:0] TIME_MASK = ~(33'h1FFFFFFFF << TIMESTAMP_WIDTH);
+
+// The library expects BANKS full banks, a remainder could not be addressed
+generate
+	if (NUMBER_OF_REGISTERS % BANKS != 0) begin : bankSizeCheck
+		$error("jtag_memory: NUMBER_OF_REGISTERS must be a multiple of BANKS");
+	end
+endgenerate
+
+localparam OP_WRITE = 3'd0;
+localparam OP_SET = 3'd1;
+localparam OP_CLEAR = 3'd2;
+localparam OP_TOGGLE = 3'd3;
+localparam OP_ADD = 3'd4;
+localparam OP_SNAPSHOT = 3'd5;
+localparam OP_CHANGES = 3'd6;
+localparam OP_STATUS = 3'd7;
+
+// Width of every register, 0 entries replaced by REGISTER_SIZE
+function [NUMBER_OF_REGISTERS*8-1:0] resolveWidths(input dummy);
+	integer k;
+	for (k = 0; k < NUMBER_OF_REGISTERS; k = k + 1)
+		resolveWidths[k*8 +: 8] = (REGISTER_WIDTHS[k*8 +: 8] == 0) ? 8'(REGISTER_SIZE) : REGISTER_WIDTHS[k*8 +: 8];
+endfunction
+
+localparam [NUMBER_OF_REGISTERS*8-1:0] WIDTHS = resolveWidths(0);
+
+// Descriptor entries: width and direction of every register
+function [NUMBER_OF_REGISTERS*16-1:0] makeEntries(input dummy);
+	integer k;
+	for (k = 0; k < NUMBER_OF_REGISTERS; k = k + 1)
+		makeEntries[k*16 +: 16] = { 2'b0, PROBE_REGISTERS[k], THRESHOLD_REGISTERS[k], OUTPUT_FIFO_REGISTERS[k], FIFO_REGISTERS[k], 
+			(REGISTER_DIRECTIONS[k*2 +: 2] == 0) ? 2'b11 : REGISTER_DIRECTIONS[k*2 +: 2], WIDTHS[k*8 +: 8] };
+endfunction
+
+localparam DESCRIPTOR_SIZE = IDREG_SIZE + NUMBER_OF_REGISTERS * 16;
+localparam [DESCRIPTOR_SIZE-1:0] DESCRIPTOR = { makeEntries(0), 8'(BANKS), 8'(TIMESTAMP_WIDTH), EXTENDED_FEATURES, BUILD_HASH, FEATURES, 8'(VERSION), 8'(REGISTER_SIZE), 
+	8'(BANK_SIZE) };
 
 wire [ADDRESS_WIDTH-1:0] NEG_ONE;
 assign NEG_ONE = $unsigned(-1);		// Constant -1
@@ -87,39 +256,163 @@ assign NEG_ONE = $unsigned(-1);		// Constant -1
 
 reg [REGISTER_SIZE-1:0] workReg = 'b0;
 reg [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] memory;
-reg [IDREG_SIZE-1:0] idReg = 'b0;				// Identifier reg
+reg [$clog2(DESCRIPTOR_SIZE+1)-1:0] idBit = 'b0;	// Position in the identifier
+reg [ADDRESS_WIDTH-1:0] burstOffset = 'b0;		// Advanced by every Update-DR in burst mode
+reg [NUMBER_OF_REGISTERS-1:0] fifoPop = 'b0;
+reg [NUMBER_OF_REGISTERS-1:0] fifoAck = 'b0;
+reg [NUMBER_OF_REGISTERS-1:0] outputPush = 'b0;
+reg [NUMBER_OF_REGISTERS-1:0] outputAck = 'b0;
+reg outputAccepted = 1'b0;		// The output FIFO had space when the stream write was captured
+reg [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] lastRead;		// Input values as last captured
+reg [BANK_SIZE-1:0] changeReg = 'b0;				// Bank 0 only
+reg [BANK_SIZE-1:0] interruptMask = 'b0;
+reg [7:0] bank = 'b0;
+reg [7:0] bankReg = 'b0;			// Shifted in by a bank select
+reg [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] shadow;		// Inputs at the last snapshot
+reg [31:0] shadowTime = 'b0;
+reg [31:0] timeReg = 'b0;			// Shifted out after the register
+reg [7:0] shiftCount = 'b0;		// Bits shifted since Capture-DR, saturates
 
 wire [ADDRESS_WIDTH-1:0] writeAddress;
 wire [ADDRESS_WIDTH-1:0] readAddress;
+wire [INDEX_WIDTH-1:0] bankOffset;
+wire [INDEX_WIDTH-1:0] writeIndex;
+wire [INDEX_WIDTH-1:0] readIndex;
+wire [7:0] readWidth;
+wire [7:0] writeWidth;
+wire [7:0] shiftLength;
+wire [2:0] operation;
+wire [REGISTER_SIZE-1:0] widthMask;
+wire [REGISTER_SIZE-1:0] operand;
+wire [REGISTER_SIZE-1:0] current;
+wire [NUMBER_OF_REGISTERS-1:0] changed;
 wire bIdRequested;
+wire bChangesRequested;
+wire bBankRequested;
+wire bSnapshotRequested;
+wire bTimeShifted;
+wire bBurst;
+wire bStreamWrite;
 
 assign oDATA = memory;
+assign oFIFO_POP = fifoPop;
+assign oFIFO_ACK = fifoAck;
+assign oOUTPUT_FIFO_PUSH = outputPush;
+assign oOUTPUT_FIFO_ACK = outputAck;
 assign readAddress = iADDRESS[ADDRESS_WIDTH-1:0];
 assign writeAddress = iADDRESS[ADDRESS_WIDTH*2-1:ADDRESS_WIDTH];
-assign bIdRequested = (readAddress == NEG_ONE) && (writeAddress == NEG_ONE);
+assign bIdRequested = (readAddress == NEG_ONE) && (writeAddress == NEG_ONE) && (operation != OP_CHANGES) && 
+	(operation != OP_SNAPSHOT || SNAPSHOT == 0) && (!bBurst || TIMESTAMP_WIDTH == 0) && (operation != OP_SET || BANKS == 1);
+assign bChangesRequested = (readAddress == NEG_ONE) && (writeAddress == NEG_ONE) && (operation == OP_CHANGES);
+assign bSnapshotRequested = (readAddress == NEG_ONE) && (writeAddress == NEG_ONE) && (operation == OP_SNAPSHOT) && 
+	(SNAPSHOT != 0);
+assign bBankRequested = (readAddress == NEG_ONE) && (writeAddress == NEG_ONE) && (operation == OP_SET) && (BANKS > 1);
+assign bBurst = !iADDRESS[ADDRESS_WIDTH*2];
+assign bankOffset = (BANKS > 1) ? bank * BANK_SIZE : 'b0;
+assign readIndex = (readAddress == NEG_ONE) ? {INDEX_WIDTH{1'b1}} : bankOffset + readAddress + (bBurst ? burstOffset : 'b0);
+assign writeIndex = (writeAddress == NEG_ONE) ? {INDEX_WIDTH{1'b1}} : bankOffset + writeAddress + (bBurst ? burstOffset : 'b0);
+assign readWidth = (readIndex < NUMBER_OF_REGISTERS) ? WIDTHS[readIndex*8 +: 8] : 8'd0;
+assign writeWidth = (writeIndex < NUMBER_OF_REGISTERS) ? WIDTHS[writeIndex*8 +: 8] : 8'd0;
+assign shiftLength = (readWidth > writeWidth) ? readWidth : writeWidth;
+assign operation = iADDRESS[ADDRESS_WIDTH*2+3:ADDRESS_WIDTH*2+1];
+assign widthMask = ~({REGISTER_SIZE{1'b1}} << writeWidth);
+
+// Only shiftLength bits were shifted in, they are in the upper part of the work register
+assign operand = (workReg >> (REGISTER_SIZE - shiftLength)) & widthMask;
+assign current = (writeIndex < NUMBER_OF_REGISTERS) ? memory[writeIndex] : 'b0;
+assign bTimeShifted = (TIMESTAMP_WIDTH != 0) && (shiftCount >= shiftLength);
+assign bStreamWrite = (operation == OP_STATUS) && (writeIndex < NUMBER_OF_REGISTERS) && OUTPUT_FIFO_REGISTERS[writeIndex];
+
+// Change flags, only the bits of the register width are compared
+genvar c;
+generate
+	for (c = 0; c < NUMBER_OF_REGISTERS; c = c + 1) begin : change
+		wire [REGISTER_SIZE-1:0] mask = ~({REGISTER_SIZE{1'b1}} << WIDTHS[c*8 +: 8]);
+		
+		assign changed[c] = (CHANGE_FLAGS != 0) && (
+			FIFO_REGISTERS[c] ? (iFIFO_STATUS[c][15:1] != 0) : 
+			THRESHOLD_REGISTERS[c] ? (((iDATA[c] & mask) >= memory[c]) != ((lastRead[c] & mask) >= memory[c])) :
+			(((iDATA[c] ^ lastRead[c]) & mask) != 0));
+	end
+endgenerate
+
+assign oINTERRUPT = |(changed[BANK_SIZE-1:0] & interruptMask);
 
 // Reset the memory content at startup
 integer i;
 initial begin
-  for (i=0;i < NUMBER_OF_REGISTERS;i=i+1)
+  for (i=0;i < NUMBER_OF_REGISTERS;i=i+1) begin
     memory[i] = 'b0;
+    lastRead[i] = 'b0;
+    shadow[i] = 'b0;
+  end
 end
 
 // Assign output bit
-assign oTDO = bIdRequested ? idReg[0] : workReg[0];
+assign oTDO = bIdRequested ? (idBit < DESCRIPTOR_SIZE && DESCRIPTOR[idBit]) : bChangesRequested ? changeReg[0] : 
+	bBankRequested ? bankReg[0] : bTimeShifted ? timeReg[0] : workReg[0];
 
 // Main procedure
 always @(posedge iTCK) begin
 
 	if (iSTATE_CDR) begin  // Capture data register: Latch data from input bus 
 		
+		// The timestamp follows every register, reads of the shadow bank get the time of the snapshot
+		shiftCount <= 'b0;
+		if (readIndex < NUMBER_OF_REGISTERS && operation == OP_SNAPSHOT && SNAPSHOT != 0) begin
+			timeReg <= shadowTime;
+		end else begin
+			timeReg <= iTIMESTAMP & TIME_MASK;
+		end
+		
 		if (bIdRequested) begin
 		
-			idReg <= { 8'(REGISTER_SIZE), 8'(NUMBER_OF_REGISTERS) };	// Fill identifier register
+			idBit <= 'b0;		// Start shifting out the identifier
+		
+		end else if (bChangesRequested) begin
+		
+			changeReg <= changed[BANK_SIZE-1:0];
+		
+		end else if (bBankRequested) begin
+		
+			bankReg <= bank;
+		
+		end else if (bSnapshotRequested) begin
+		
+			shadow <= iDATA;		// All registers in the same clock
+			shadowTime <= iTIMESTAMP & TIME_MASK;
+			workReg <= 'b0;
+		
+		end else if (readIndex < NUMBER_OF_REGISTERS && operation == OP_SNAPSHOT && SNAPSHOT != 0) begin
+		
+			workReg <= shadow[readIndex];								// Capture from the shadow bank
 		
-		end else if (readAddress < NUMBER_OF_ALL_REGISTERS) begin
+		end else if (bStreamWrite) begin
 		
-			workReg <= iDATA[readAddress];								// Capture input
+			workReg <= iOUTPUT_FIFO_STATUS[writeIndex];					// Status of the output FIFO
+			outputAck[writeIndex] <= !outputAck[writeIndex];
+			outputAccepted <= (iOUTPUT_FIFO_STATUS[writeIndex][15:1] != 0);
+		
+		end else if (readIndex < NUMBER_OF_REGISTERS && OUTPUT_FIFO_REGISTERS[readIndex] && !FIFO_REGISTERS[readIndex] && 
+			operation == OP_STATUS) begin
+		
+			workReg <= iOUTPUT_FIFO_STATUS[readIndex];
+			outputAck[readIndex] <= !outputAck[readIndex];
+		
+		end else if (readIndex < NUMBER_OF_REGISTERS && FIFO_REGISTERS[readIndex] && operation == OP_STATUS) begin
+		
+			workReg <= iFIFO_STATUS[readIndex];							// Capture the FIFO status
+			fifoAck[readIndex] <= !fifoAck[readIndex];
+		
+		end else if (readIndex < NUMBER_OF_REGISTERS) begin
+		
+			workReg <= iDATA[readIndex];								// Capture input
+			lastRead[readIndex] <= iDATA[readIndex];
+			
+			// Take the entry out of the FIFO, unless it was empty when the data was captured
+			if (FIFO_REGISTERS[readIndex] && iFIFO_STATUS[readIndex][15:1] != 0) begin
+				fifoPop[readIndex] <= !fifoPop[readIndex];
+			end
 			
 		end else begin
 		
@@ -129,20 +422,60 @@ always @(posedge iTCK) begin
 	
 	end else if (iSTATE_SDR) begin		// Shift data register: Main workload
 		
-		// Shift data in
-		workReg <= {iTDI, workReg[REGISTER_SIZE-1:1]};
-		idReg <= {1'b0, idReg[IDREG_SIZE-1:1]};
+		// Shift data in. Once the register is complete the timestamp follows, the work register keeps the value
+		if (bTimeShifted) begin
+			timeReg <= timeReg >> 1;
+		end else begin
+			workReg <= {iTDI, workReg[REGISTER_SIZE-1:1]};
+		end
+		if (shiftCount != 8'hFF) shiftCount <= shiftCount + 1'b1;
+		changeReg <= {iTDI, changeReg[BANK_SIZE-1:1]};		// The new interrupt mask
+		bankReg <= {iTDI, bankReg[7:1]};
+		if (idBit < DESCRIPTOR_SIZE) idBit <= idBit + 1'b1;
 		
 	end else if (iSTATE_UDR) begin		// Update data register: Latch received data to the output bus
 		
-		// Transfer done, now write received data to corresponding register
+		// Transfer done, now apply the received data to the corresponding register
+		
+		if (bChangesRequested) begin
+		
+			interruptMask <= changeReg;
+		
+		end
+		
+		if (bBankRequested && bankReg < BANKS) begin
+		
+			bank <= bankReg;
+		
+		end
+		
+		if (writeIndex < NUMBER_OF_REGISTERS && (!bStreamWrite || outputAccepted)) begin
+		
+			case (operation)
+				OP_SET:    memory[writeIndex] <= current | operand;
+				OP_CLEAR:  memory[writeIndex] <= current & ~operand;
+				OP_TOGGLE: memory[writeIndex] <= current ^ operand;
+				OP_ADD:    memory[writeIndex] <= (current + operand) & widthMask;
+				default:   memory[writeIndex] <= operand;
+			endcase
+			
+			// The output FIFO takes the new value from oDATA after the toggle was synchronized
+			if (OUTPUT_FIFO_REGISTERS[writeIndex]) begin
+				outputPush[writeIndex] <= !outputPush[writeIndex];
+			end
 		
-		if (writeAddress < NUMBER_OF_ALL_REGISTERS) begin
+		end
+		
+		if (bBurst) begin
 		
-			memory[writeAddress] <= workReg;
+			burstOffset <= burstOffset + 1'b1;
 		
 		end
 	
+	end else if (iSTATE_UIR) begin		// Update instruction register: A new address restarts the burst
+	
+		burstOffset <= 'b0;
+	
 	end
 	
 end
@@ -0,0 +1,110 @@
+//
+// Bus monitor of jtag_interface, instanced with MONITOR = 1. Counts what jtag_memory sees of the JTAG
+//   transactions, in clocks of iMAIN_CLK, so the load of the bus can be measured independent of the timers of
+//   the Arduino. Internal, all counters are free-running and wrap, read two of them and take the difference.
+//
+//   oMONITOR[0]  Capture-DR events (scans started, the descriptor and change flag scans included)
+//   oMONITOR[1]  Update-DR events (scans completed)
+//   oMONITOR[2]  TCK rising edges
+//   oMONITOR[3]  Busy clocks, from Capture-DR to the following Update-DR
+//   oMONITOR[4]  Idle clocks, from Update-DR to the next Capture-DR
+//   oMONITOR[5]  Length of the last idle gap
+//   oMONITOR[6]  Longest idle gap since startup (the first one after startup is left out)
+//   oMONITOR[7]  Clocks taken by the last 64 TCK edges in Shift-DR, TCK = 64 * f(iMAIN_CLK) / value
+//
+// The inputs are the outputs of jtag_synchronizer, so an event is counted at the rising edge of the
+//   synchronized TCK like in jtag_memory.
+//
+// Limit: the monitor always counts the synchronized signals, also with TCK_DOMAIN = 1 where jtag_memory itself
+//   runs on TCK. The synchronizer samples TCK and the states with iMAIN_CLK, so once a half period of TCK comes
+//   close to one clock of iMAIN_CLK, edges and the one TCK long Capture-DR and Update-DR are missed depending
+//   on the phase. The counters then undercount and oMONITOR[7] reads too low a TCK. With TCK_DOMAIN = 1 the
+//   numbers are only a lower bound unless TCK stays well below half of iMAIN_CLK.
+//
+
+module jtag_monitor (
+	input iMAIN_CLK,
+	input iTCK,
+	input iSTATE_CDR,
+	input iSTATE_SDR,
+	input iSTATE_UDR,
+	
+	output [7:0][31:0] oMONITOR
+);
+
+reg tckLast = 1'b0;
+reg busy = 1'b0;
+reg started = 1'b0;			// The first gap is the time since startup, not counted as a gap
+reg [31:0] captures = 'b0;
+reg [31:0] updates = 'b0;
+reg [31:0] edges = 'b0;
+reg [31:0] busyClocks = 'b0;
+reg [31:0] idleClocks = 'b0;
+reg [31:0] gap = 'b0;
+reg [31:0] lastGap = 'b0;
+reg [31:0] maxGap = 'b0;
+reg [31:0] windowClocks = 'b0;
+reg [31:0] tckWindow = 'b0;
+reg [5:0] windowEdges = 'b0;
+
+wire tckRise;
+
+assign tckRise = iTCK && !tckLast;
+assign oMONITOR = { tckWindow, maxGap, lastGap, idleClocks, busyClocks, edges, updates, captures };
+
+always @(posedge iMAIN_CLK) begin
+
+	tckLast <= iTCK;
+	
+	if (busy) begin
+		busyClocks <= busyClocks + 1'b1;
+	end else if (started) begin
+		idleClocks <= idleClocks + 1'b1;
+		gap <= gap + 1'b1;
+	end
+	
+	if (tckRise) begin
+	
+		edges <= edges + 1'b1;
+		
+		if (iSTATE_CDR) begin
+		
+			captures <= captures + 1'b1;
+			busy <= 1'b1;
+			
+			if (started) begin
+				lastGap <= gap;
+				if (gap > maxGap) maxGap <= gap;
+			end
+			gap <= 'b0;
+		
+		end
+		
+		if (iSTATE_UDR) begin
+		
+			updates <= updates + 1'b1;
+			busy <= 1'b0;
+			started <= 1'b1;
+		
+		end
+	
+	end
+	
+	// TCK frequency: clocks of 64 consecutive edges while shifting
+	if (iSTATE_SDR) begin
+	
+		windowClocks <= windowClocks + 1'b1;
+		
+		if (tckRise) begin
+			windowEdges <= windowEdges + 1'b1;
+			if (windowEdges == 6'd63) begin
+				tckWindow <= windowClocks + 1'b1;
+				windowClocks <= 'b0;
+			end
+		end
+	
+	end
+
+end
+
+endmodule
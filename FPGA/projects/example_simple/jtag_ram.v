@@ -0,0 +1,127 @@
+//
+// Register file of jtag_register_file.v in block RAM. Internal, instanced by jtag_register_file.
+//
+// jtag_memory keeps every register in flip-flops and selects the captured one with a multiplexer, which is
+//   fine for a few dozen registers but not for parameter tables of thousands of words. Here the words are
+//   stored in one RAM (M9K blocks), which has a JTAG port (clocked by the synchronized TCK like jtag_memory)
+//   and a port for the FPGA design on iCLK.
+//
+// Instruction: { write, address }, with addressWidth = ceil(log2(WORDS + 1)), so up to 16 bits for 65535 words.
+//   Every data register scan captures the word at the address and shifts exactly WIDTH bits. With the write bit
+//   set the shifted in value replaces the word at Update-DR. Every Update-DR advances the address by one, so any
+//   number of consecutive words are transferred with a single instruction (burst mode of jtag_memory without
+//   the single access bit). Update-IR restarts at the address of the instruction.
+//
+//   The RAM has a read latency of one clock: it is read at every TCK and the Capture-DR takes the word read in
+//   the state before (Select-DR), after the address was advanced at Update-DR.
+//
+// All instruction bits set shifts out the descriptor, in the format of jtag_memory (version 4) without
+//   register entries: [7:0] 0 registers, [15:8] WIDTH, [31:24] burst mode, [63:32] BUILD_HASH, [79:64] bit 2
+//   (register file), followed by [127:96] the number of words. See FPGARegisterFile.h for the Arduino side.
+//
+
+module jtag_ram #(
+	parameter WIDTH,
+	parameter WORDS,
+	parameter [31:0] BUILD_HASH = 'b0,
+	parameter INIT_FILE = ""
+) (
+	input iTCK,
+	input iTDI,
+	input iSTATE_SDR,
+	input iSTATE_CDR,
+	input iSTATE_UDR,
+	input iSTATE_UIR,
+	output oTDO,
+	
+	input [ADDRESS_WIDTH:0] iADDRESS,
+	
+	input iCLK,					// Port of the FPGA design
+	input [15:0] iRAM_ADDRESS,
+	input iRAM_WRITE,
+	input [WIDTH-1:0] iRAM_DATA,
+	output reg [WIDTH-1:0] oRAM_DATA
+);
+
+localparam ADDRESS_WIDTH = $clog2(WORDS + 1);
+localparam IDREG_SIZE = 96;
+localparam VERSION = 4;
+localparam [7:0] FEATURES = 8'b1;				// Burst mode
+localparam [15:0] EXTENDED_FEATURES = 16'b100;	// Register file
+localparam DESCRIPTOR_SIZE = IDREG_SIZE + 32;
+localparam [DESCRIPTOR_SIZE-1:0] DESCRIPTOR = { 32'(WORDS), 16'b0, EXTENDED_FEATURES, BUILD_HASH, FEATURES, 
+	8'(VERSION), 8'(WIDTH), 8'b0 };
+
+// The address of the descriptor instruction, all ones, is at least WORDS because of the extra address bit, so it
+// is never a word. The library addresses 16 bits at most
+generate
+	if (WORDS < 1 || WORDS > 65535) begin : wordsCheck
+		$error("jtag_ram: WORDS must be between 1 and 65535");
+	end
+endgenerate
+
+(* ramstyle = "M9K" *) reg [WIDTH-1:0] ram [0:WORDS-1];
+
+reg [WIDTH-1:0] workReg = 'b0;
+reg [WIDTH-1:0] ramData = 'b0;				// Word at index, one TCK late
+reg [$clog2(DESCRIPTOR_SIZE+1)-1:0] idBit = 'b0;	// Position in the identifier
+reg [ADDRESS_WIDTH-1:0] burstOffset = 'b0;		// Advanced by every Update-DR
+
+wire [ADDRESS_WIDTH-1:0] index;
+wire bIdRequested;
+wire bWrite;
+wire bRamWrite;
+
+assign index = iADDRESS[ADDRESS_WIDTH-1:0] + burstOffset;
+assign bIdRequested = &iADDRESS;
+assign bWrite = iADDRESS[ADDRESS_WIDTH];
+assign bRamWrite = iSTATE_UDR && bWrite && !bIdRequested && index < WORDS;	// The descriptor index wraps to 0
+
+initial begin
+	oRAM_DATA = 'b0;
+	if (INIT_FILE != "") $readmemh(INIT_FILE, ram);
+end
+
+assign oTDO = bIdRequested ? (idBit < DESCRIPTOR_SIZE && DESCRIPTOR[idBit]) : workReg[0];
+
+// JTAG port
+always @(posedge iTCK) begin
+
+	if (bRamWrite) ram[index] <= workReg;
+	ramData <= ram[index];
+
+end
+
+always @(posedge iTCK) begin
+
+	if (iSTATE_CDR) begin
+	
+		idBit <= 'b0;
+		workReg <= ramData;
+	
+	end else if (iSTATE_SDR) begin
+	
+		workReg <= {iTDI, workReg[WIDTH-1:1]};
+		if (idBit < DESCRIPTOR_SIZE) idBit <= idBit + 1'b1;
+	
+	end else if (iSTATE_UDR) begin
+	
+		burstOffset <= burstOffset + 1'b1;
+	
+	end else if (iSTATE_UIR) begin		// A new address restarts the burst
+	
+		burstOffset <= 'b0;
+	
+	end
+
+end
+
+// Port of the FPGA design, reads return the old word when both ports access the same address
+always @(posedge iCLK) begin
+
+	if (iRAM_WRITE) ram[iRAM_ADDRESS] <= iRAM_DATA;
+	oRAM_DATA <= ram[iRAM_ADDRESS];
+
+end
+
+endmodule
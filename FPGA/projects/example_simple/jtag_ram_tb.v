@@ -0,0 +1,243 @@
+//
+// Testbench for jtag_ram, the block RAM register file of jtag_register_file, without the Altera virtual JTAG.
+//   The tasks drive the synchronized JTAG states like jtag_synchronizer and the same sequences as
+//   FPGARegisterFile: one instruction, then a chain of data register scans that advance the address.
+//
+// ModelSim: vlog -sv jtag_ram.v jtag_ram_tb.v
+//           vsim -c jtag_ram_tb -do "run -all"
+//
+// Prints PASSED or FAILED with the number of errors.
+//
+
+`timescale 1ns / 1ps
+
+module jtag_ram_tb();
+
+localparam WIDTH = 24;
+localparam WORDS = 1000;
+localparam ADDRESS_WIDTH = $clog2(WORDS + 1);
+
+reg rCLK = 1'b0;
+reg rTCK = 1'b0;
+reg rTDI = 1'b0;
+reg rCDR = 1'b0;
+reg rSDR = 1'b0;
+reg rUDR = 1'b0;
+reg rUIR = 1'b0;
+reg [ADDRESS_WIDTH:0] rADDRESS = 'b0;
+reg [15:0] rRAM_ADDRESS = 'b0;
+reg rRAM_WRITE = 1'b0;
+reg [WIDTH-1:0] rRAM_DATA = 'b0;
+
+wire wTDO;
+wire [WIDTH-1:0] wRAM_DATA;
+
+always
+#1 rCLK <= !rCLK;
+
+jtag_ram #(
+
+	.WIDTH(WIDTH),
+	.WORDS(WORDS),
+	.BUILD_HASH(32'hC0FFEE00)
+
+) ram (
+
+	.iADDRESS(rADDRESS),
+	.iTCK(rTCK),
+	.iTDI(rTDI),
+	.iSTATE_CDR(rCDR),
+	.iSTATE_SDR(rSDR),
+	.iSTATE_UDR(rUDR),
+	.iSTATE_UIR(rUIR),
+	.oTDO(wTDO),
+
+	.iCLK(rCLK),
+	.iRAM_ADDRESS(rRAM_ADDRESS),
+	.iRAM_WRITE(rRAM_WRITE),
+	.iRAM_DATA(rRAM_DATA),
+	.oRAM_DATA(wRAM_DATA)
+
+);
+
+integer errors = 0;
+
+// One TCK period, 8 main clocks like a slow JTAG clock after jtag_synchronizer
+task tck;
+begin
+	repeat (4) @(posedge rCLK);
+	rTCK <= 1'b1;
+	repeat (4) @(posedge rCLK);
+	rTCK <= 1'b0;
+end
+endtask
+
+task instruction(input write, input [ADDRESS_WIDTH-1:0] address);
+begin
+	rADDRESS = { write, address };
+	rUIR = 1'b1;
+	tck;
+	rUIR = 1'b0;
+	tck;			// Run-Test/Idle
+end
+endtask
+
+// Select-DR, Capture-DR, Shift-DR for all bits, Update-DR
+task scan(input integer bits, input [127:0] send, output [127:0] recv);
+integer b;
+begin
+	recv = 'b0;
+	tck;
+	rCDR = 1'b1;
+	tck;
+	rCDR = 1'b0;
+	rSDR = 1'b1;
+	for (b = 0; b < bits; b = b + 1) begin
+		recv[b] = wTDO;
+		rTDI = send[b];
+		tck;
+	end
+	rSDR = 1'b0;
+	rUDR = 1'b1;
+	tck;
+	rUDR = 1'b0;
+end
+endtask
+
+// Write from the port of the FPGA design
+task designWrite(input [15:0] address, input [WIDTH-1:0] data);
+begin
+	@(posedge rCLK);
+	rRAM_ADDRESS <= address;
+	rRAM_DATA <= data;
+	rRAM_WRITE <= 1'b1;
+	@(posedge rCLK);
+	rRAM_WRITE <= 1'b0;
+end
+endtask
+
+task check(input [127:0] value, input [127:0] expected, input [8*32-1:0] what);
+begin
+	if (value !== expected) begin
+		$display("ERROR: %0s is %h, expected %h", what, value, expected);
+		errors = errors + 1;
+	end
+end
+endtask
+
+function [WIDTH-1:0] pattern(input integer address);
+	pattern = (address * 24'h010203) ^ 24'hA5A5A5;
+endfunction
+
+integer i;
+reg [127:0] value;
+
+initial begin
+	repeat (10) @(posedge rCLK);
+
+	// Descriptor: no registers, the width, version 4, burst mode, the build hash, the register file flag, the words
+	instruction(1'b1, {ADDRESS_WIDTH{1'b1}});
+	scan(128, 'b0, value);
+	check(value, { 32'd1000, 16'b0, 16'b100, 32'hC0FFEE00, 8'd1, 8'd4, 8'd24, 8'd0 }, "descriptor");
+
+	// Burst write over the whole range
+	instruction(1'b1, 0);
+	for (i = 0; i < WORDS; i = i + 1) scan(WIDTH, pattern(i), value);
+
+	// Read a block in the middle, then continue without a new instruction
+	instruction(1'b0, 500);
+	for (i = 500; i < 510; i = i + 1) begin
+		scan(WIDTH, 'b0, value);
+		check(value, pattern(i), "burst read");
+	end
+	for (i = 510; i < 520; i = i + 1) begin
+		scan(WIDTH, 'b0, value);
+		check(value, pattern(i), "continued read");
+	end
+
+	// A new instruction restarts at its address, the last word is still in range
+	instruction(1'b0, WORDS - 1);
+	scan(WIDTH, 'b0, value);
+	check(value, pattern(WORDS - 1), "last word");
+
+	// A write scan shifts out the old word
+	instruction(1'b1, 7);
+	scan(WIDTH, 24'h123456, value);
+	check(value, pattern(7), "old word");
+
+	// The FPGA design sees the JTAG writes and its writes are read over JTAG
+	@(posedge rCLK);
+	rRAM_ADDRESS <= 7;
+	repeat (2) @(posedge rCLK);
+	check(wRAM_DATA, 24'h123456, "design read");
+	designWrite(8, 24'h654321);
+	instruction(1'b0, 8);
+	scan(WIDTH, 'b0, value);
+	check(value, 24'h654321, "design write");
+
+	// The RAM is read one TCK before Capture-DR, in Select-DR: a design write in between is not captured yet
+	instruction(1'b0, 40);
+	tck;			// Select-DR
+	designWrite(40, 24'h0F0F0F);
+	rCDR = 1'b1;
+	tck;
+	rCDR = 1'b0;
+	rSDR = 1'b1;
+	for (i = 0; i < WIDTH; i = i + 1) begin
+		value[i] = wTDO;
+		tck;
+	end
+	rSDR = 1'b0;
+	rUDR = 1'b1;
+	tck;
+	rUDR = 1'b0;
+	check(value[WIDTH-1:0], pattern(40), "word read in Select-DR");
+	scan(WIDTH, 'b0, value);
+	check(value, pattern(41), "word after the latency check");
+	instruction(1'b0, 40);
+	scan(WIDTH, 'b0, value);
+	check(value, 24'h0F0F0F, "design write after Select-DR");
+
+	// Only Update-DR advances the address: a scan paused in the middle (Exit1-DR, Pause-DR, Exit2-DR) is one word
+	instruction(1'b1, 60);
+	tck;
+	rCDR = 1'b1;
+	tck;
+	rCDR = 1'b0;
+	for (i = 0; i < WIDTH; i = i + 1) begin
+		rSDR = 1'b1;
+		rTDI = i[0];
+		tck;
+		rSDR = 1'b0;
+		if (i == WIDTH / 2 - 1) repeat (3) tck;
+	end
+	rUDR = 1'b1;
+	tck;
+	rUDR = 1'b0;
+	scan(WIDTH, 24'h00BEEF, value);
+	instruction(1'b0, 60);
+	scan(WIDTH, 'b0, value);
+	check(value, {WIDTH/2{2'b10}}, "paused write");
+	scan(WIDTH, 'b0, value);
+	check(value, 24'h00BEEF, "word after the paused write");
+	scan(WIDTH, 'b0, value);
+	check(value, pattern(62), "word after the paused burst");
+
+	// The descriptor instruction has the write bit set. Its address plus the burst offset wraps around to
+	// word 0 after the first scan, neither scan may write there
+	instruction(1'b1, {ADDRESS_WIDTH{1'b1}});
+	scan(128, {128{1'b1}}, value);
+	scan(128, {128{1'b1}}, value);
+	scan(128, {128{1'b1}}, value);
+	instruction(1'b0, 0);
+	scan(WIDTH, 'b0, value);
+	check(value, pattern(0), "word 0 after descriptor scans");
+	scan(WIDTH, 'b0, value);
+	check(value, pattern(1), "word 1 after descriptor scans");
+
+	if (errors == 0) $display("PASSED");
+	else $display("FAILED: %0d errors", errors);
+	$finish;
+end
+
+endmodule
@@ -0,0 +1,120 @@
+//
+// Register file of up to 65535 words in block RAM, e.g. for parameter tables that would not fit into the
+//   flip-flops of jtag_interface. It is a separate slave of the virtual JTAG hub next to jtag_interface: set
+//   INSTANCE and access it with FPGARegisterFile(instance) on the Arduino side. The FPGA design reads and writes
+//   the words on its own port, oDATA is the word at iADDRESS one clock later. See jtag_ram.v for the protocol.
+//
+// Example, 4096 words of 32 bits in 16 M9K blocks:
+//
+//   jtag_register_file #(.WIDTH(32), .WORDS(4096), .INSTANCE(1)) table(
+//       .iMAIN_CLK(wCLK120), .iADDRESS(address), .iWRITE(1'b0), .iDATA('b0), .oDATA(coefficient));
+//
+
+module jtag_register_file #(
+	parameter WIDTH = 32,				// Up to 64
+	parameter WORDS = 4096,				// Up to 65535
+	parameter [31:0] BUILD_HASH = 'b0,
+	parameter INSTANCE = -1,			// Instance number for FPGARegisterFile(instance), -1 lets Quartus count them up
+	parameter INIT_FILE = ""			// Optional initial content, read with $readmemh
+) (
+	input iMAIN_CLK,
+	input [15:0] iADDRESS,
+	input iWRITE,
+	input [WIDTH-1:0] iDATA,
+	output [WIDTH-1:0] oDATA
+);
+
+localparam ADDRESS_WIDTH = $clog2(WORDS + 1);
+
+wire tdi;
+wire tdo;
+wire tck;
+wire cdr;
+wire sdr;
+wire udr;
+wire uir;
+
+wire tdiSync;
+wire tckSync;
+wire cdrSync;
+wire sdrSync;
+wire udrSync;
+wire uirSync;
+wire tdoSync;
+
+wire [ADDRESS_WIDTH:0] address;
+
+sld_virtual_jtag #(
+
+	.sld_ir_width(ADDRESS_WIDTH + 1),
+	.sld_auto_instance_index(INSTANCE < 0 ? "YES" : "NO"),
+	.sld_instance_index(INSTANCE < 0 ? 0 : INSTANCE)
+	
+) jtag (
+
+	.tdo(tdo),
+	.tdi(tdi),
+	.tck(tck),
+	.ir_in(address),
+	.virtual_state_cdr(cdr),
+	.virtual_state_sdr(sdr),
+	.virtual_state_udr(udr),
+	.virtual_state_uir(uir)
+	
+);
+
+jtag_synchronizer jtag_sync(
+
+	.iMAIN_CLK(iMAIN_CLK),
+	
+	.iTDI(tdi),
+	.iTCK(tck),
+	.iSTATE_CDR(cdr),
+	.iSTATE_SDR(sdr),
+	.iSTATE_UDR(udr),
+	.oTDO(tdo),
+	
+	.oTDI(tdiSync),
+	.oTCK(tckSync),
+	.oSTATE_CDR(cdrSync),
+	.oSTATE_SDR(sdrSync),
+	.oSTATE_UDR(udrSync),
+	.iTDO(tdoSync)
+	
+);
+
+synchronizer_basic uir_sync(
+
+	.iCLK(iMAIN_CLK),
+	.iSIGNAL(uir),
+	.oSYNCHRONIZED(uirSync)
+	
+);
+
+jtag_ram #(
+
+	.WIDTH(WIDTH),
+	.WORDS(WORDS),
+	.BUILD_HASH(BUILD_HASH),
+	.INIT_FILE(INIT_FILE)
+
+) ram (
+
+	.iADDRESS(address),
+	.iTCK(tckSync),
+	.iTDI(tdiSync),
+	.iSTATE_CDR(cdrSync),
+	.iSTATE_SDR(sdrSync),
+	.iSTATE_UDR(udrSync),
+	.iSTATE_UIR(uirSync),
+	.oTDO(tdoSync),
+	
+	.iCLK(iMAIN_CLK),
+	.iRAM_ADDRESS(iADDRESS),
+	.iRAM_WRITE(iWRITE),
+	.iRAM_DATA(iDATA),
+	.oRAM_DATA(oDATA)
+	
+);
+
+endmodule
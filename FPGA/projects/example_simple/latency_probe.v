@@ -0,0 +1,28 @@
+//
+// Probe for FPGATiming::measureWriteLatency() of the Arduino library: oTICKS holds the value of iTICKS from the
+//   clock in which iDATA last changed. Connect iDATA to the oDATA of the output register under test, iTICKS to
+//   the same free-running counter as the tick register (register 9 in MyDesign.bdf) and oTICKS to a spare input
+//   register of jtag_interface, the probe register. Mark the probe register in PROBE_REGISTERS of jtag_interface,
+//   FPGATiming only measures with registers the descriptor reports as probes. The measured latency then ends at
+//   the clock in which the new value reached the design.
+//
+
+module latency_probe #(
+	parameter WIDTH = 32
+) (
+	input iCLK,
+	input [WIDTH-1:0] iDATA,
+	input [31:0] iTICKS,
+	output reg [31:0] oTICKS = 'b0
+);
+
+reg [WIDTH-1:0] last = 'b0;
+
+always @(posedge iCLK) begin
+
+	last <= iDATA;
+	if (iDATA != last) oTICKS <= iTICKS;
+
+end
+
+endmodule
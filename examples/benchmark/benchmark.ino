@@ -0,0 +1,121 @@
+//
+// This example measures the JTAG bus with the clock of the FPGA. It needs the bitstream of
+// FPGA/projects/example_benchmark: jtag_interface counts the scans, the TCK edges and the clocks in which
+// the bus was busy or idle, so the utilisation of the bus (busy clocks over wall time) and the real TCK
+// frequency can be printed for every workload, independent of the timers of the Arduino.
+//
+// Replace FPGA_Bitstream.h with the one generated from the benchmark project before uploading.
+//
+
+#include "FPGA.h"
+#include "FPGATiming.h"
+
+#define ITERATIONS 1000
+#define CLOCK_MHZ 120.0
+
+enum Counter { CAPTURES, UPDATES, TCK_EDGES, BUSY, IDLE, LAST_GAP, MAX_GAP, TCK_WINDOW, PROBE, TICKS };
+
+FPGATiming timing;
+int64_t before[10];
+int64_t after[10];
+
+void startWorkload() {
+	FPGA.readBurst(CAPTURES, before, 10);		// The counters and the tick counter in one burst
+}
+
+void printWorkload(const char* name) {
+	FPGA.readBurst(CAPTURES, after, 10);
+
+	uint32_t wall = (uint32_t)(after[TICKS] - before[TICKS]);
+	uint32_t scans = (uint32_t)(after[CAPTURES] - before[CAPTURES]);
+	uint32_t busy = (uint32_t)(after[BUSY] - before[BUSY]);
+	uint32_t idle = (uint32_t)(after[IDLE] - before[IDLE]);
+
+	Serial.print(name);
+	Serial.print(wall / CLOCK_MHZ / ITERATIONS);
+	Serial.print(" us each, ");
+	Serial.print(scans);
+	Serial.print(" scans, utilisation ");
+	Serial.print(100.0 * busy / wall);
+	Serial.print(" %, mean gap ");
+	Serial.print(scans ? idle / CLOCK_MHZ / scans : 0);
+	Serial.print(" us, TCK ");
+	Serial.print(after[TCK_WINDOW] ? 64 * CLOCK_MHZ / (uint32_t)after[TCK_WINDOW] : 0);
+	Serial.println(" MHz");
+}
+
+void printLatency(const char* name, const FPGALatency& latency) {
+	Serial.print(name);
+	Serial.print(latency.min);
+	Serial.print(" / ");
+	Serial.print(latency.mean);
+	Serial.print(" / ");
+	Serial.print(latency.max);
+	Serial.println(" us (min / mean / max)");
+}
+
+void setup() {
+
+	Serial.begin(115200);	// Wait for serial monitor to open
+	while(!Serial);
+
+	if (!FPGA.begin()) {								// You should always check this
+		Serial.println("JTAG FPGA mismatch. Error:");
+		Serial.println(FPGA.getErrorMessage());
+		while (true);
+	}
+
+	timing.begin(TICKS, CLOCK_MHZ, 100000);
+	Serial.println("JTAG initialized");
+
+}
+
+void loop() {
+
+	int64_t values[6] = { 1, 2, 3, 4, 5, 6 };
+	int64_t sum = 0;
+
+	startWorkload();
+	for (int i = 0; i < ITERATIONS; i++) sum += FPGA.read(10);
+	printWorkload("FPGA.read():          ");
+
+	startWorkload();
+	for (int i = 0; i < ITERATIONS; i++) FPGA.write(10, i);
+	printWorkload("FPGA.write():         ");
+
+	startWorkload();
+	for (int i = 0; i < ITERATIONS; i++) sum += FPGA.transfer(10, 11, i);
+	printWorkload("FPGA.transfer():      ");
+
+	startWorkload();
+	for (int i = 0; i < ITERATIONS; i++) FPGA.readBurst(10, values, 6);
+	printWorkload("FPGA.readBurst(6):    ");
+
+	startWorkload();
+	for (int i = 0; i < ITERATIONS; i++) FPGA.writeBurst(10, values, 6);
+	printWorkload("FPGA.writeBurst(6):   ");
+
+	Serial.print("Longest idle gap since startup: ");
+	Serial.print((uint32_t)after[MAX_GAP] / CLOCK_MHZ);
+	Serial.println(" us");
+
+	// End to end, in micros() of the Arduino
+	for (int i = 0; i < 10; i++) {
+		timing.sample();
+		delay(10);
+	}
+
+	FPGALatency latency;
+	timing.measureReadLatency(latency);
+	printLatency("Sample to read:  ", latency);
+	timing.measureWriteLatency(PROBE, PROBE, latency);
+	printLatency("Write to effect: ", latency);
+
+	Serial.print("Clock drift: ");
+	Serial.print(timing.getDrift());
+	Serial.println(" ppm");
+
+	Serial.println();
+	delay(1000);
+
+}
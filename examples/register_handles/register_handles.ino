@@ -0,0 +1,88 @@
+//
+// This example shows the typed register handles of FPGAInterface<> and measures them against
+// the other ways of accessing a register. It uses the default bitstream (32-bit registers, 16 registers).
+//
+// A handle is an empty class, the static_asserts below check that it carries no state. Assigning to it
+// converts the value and calls the same transfer as fpga.write<>(), the loop prints the time of both next
+// to FPGA.write(), which converts through int64_t.
+//
+
+#include "FPGAInterface.h"
+
+typedef FPGAInterface<32, 16> MyFPGA;
+
+MyFPGA fpga;
+MyFPGA::Register<float, 5> speedSetpoint;
+MyFPGA::InputRegister<uint32_t, 9> ticks;
+
+// An empty class still takes one byte, anything more would be state
+static_assert(sizeof(speedSetpoint) == 1, "Register<> must not carry any state");
+static_assert(sizeof(ticks) == 1, "InputRegister<> must not carry any state");
+
+#define ITERATIONS 1000
+
+volatile uint32_t readSink;		// Keeps the compiler from dropping the reads
+
+__attribute__((noinline)) void writeHandle(float value) {
+	speedSetpoint = value;
+}
+
+__attribute__((noinline)) void writeDirect(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	fpga.write<5>(bits);
+}
+
+__attribute__((noinline)) void writeLegacy(float value) {
+	FPGA.write(5, FPGA.toBytes<float>(value));
+}
+
+void printTime(const char* name, uint32_t start) {
+	Serial.print(name);
+	Serial.print((micros() - start) / (float)ITERATIONS);
+	Serial.println(" us");
+}
+
+void setup() {
+
+	Serial.begin(115200);	// Wait for serial monitor to open
+	while(!Serial);
+
+	if (!fpga.begin()) {								// You should always check this
+		Serial.println("JTAG FPGA mismatch. Error:");
+		Serial.println(fpga.getErrorMessage());
+		while (true);
+	}
+
+	Serial.println("JTAG initialized");
+
+}
+
+void loop() {
+
+	uint32_t start = micros();
+	for (int i = 0; i < ITERATIONS; i++) writeHandle(18.7f);
+	printTime("Register<float, 5> = 18.7f:          ", start);
+
+	start = micros();
+	for (int i = 0; i < ITERATIONS; i++) writeDirect(18.7f);
+	printTime("fpga.write<5>():                     ", start);
+
+	start = micros();
+	for (int i = 0; i < ITERATIONS; i++) writeLegacy(18.7f);
+	printTime("FPGA.write(5, FPGA.toBytes<float>()):", start);
+
+	uint32_t sum = 0;
+	start = micros();
+	for (int i = 0; i < ITERATIONS; i++) sum += ticks;
+	printTime("InputRegister<uint32_t, 9>:          ", start);
+
+	start = micros();
+	for (int i = 0; i < ITERATIONS; i++) sum += FPGA.read(9);
+	printTime("FPGA.read(9):                        ", start);
+	readSink = sum;
+
+	Serial.println();
+	delay(1000);
+
+}
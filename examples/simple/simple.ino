@@ -28,6 +28,7 @@ void setup() {
 
 	// Next, upload the FPGA bitstream and initialize the JTAG_Interface (takes a sec)
 	// You must specify the register bit width and the number of registers.
+	// With a current jtag_memory.v, FPGA.begin() without arguments reads them from the FPGA instead.
 
 	if (!FPGA.begin(32, 16)) {							// You should always check this
 		Serial.println("JTAG FPGA mismatch. Error:");
@@ -0,0 +1,134 @@
+//
+// Stand-in for the Arduino core, so that the sources in src/ can be compiled on the host. In C++ the
+// PORT registers are connected to the JTAG model of bridge_model.cpp: every write to OUTSET/OUTCLR
+// drives the pins and a rising edge of TCK clocks the model, reading IN returns its TDO.
+//
+// The rest (interrupts, Serial, the DMAC and SERCOM registers) is only declared, enough for the
+// compile check of check_compile.sh. bridge_model.cpp defines what FPGA.cpp needs to run against
+// the model, Serial is not defined anywhere.
+//
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#define OUTPUT 1
+#define INPUT 0
+#define HIGH 1
+#define LOW 0
+#define LED_BUILTIN 6
+#define FALLING 2
+#define RISING 3
+#define CHANGE 4
+
+#ifdef __cplusplus
+
+void hostPortWrite(int reg, uint32_t mask);
+uint32_t hostPortRead();
+
+enum { HOST_DIRSET, HOST_DIRCLR, HOST_OUTSET, HOST_OUTCLR, HOST_IN };
+
+template<int Reg>
+struct HostRegister {
+	HostRegister& operator=(uint32_t mask) { hostPortWrite(Reg, mask); return *this; }
+	operator uint32_t() const { return hostPortRead(); }
+};
+
+typedef struct { HostRegister<HOST_DIRSET> reg; } HostDirSet;
+typedef struct { HostRegister<HOST_DIRCLR> reg; } HostDirClr;
+typedef struct { HostRegister<HOST_OUTSET> reg; } HostOutSet;
+typedef struct { HostRegister<HOST_OUTCLR> reg; } HostOutClr;
+typedef struct { HostRegister<HOST_IN> reg; } HostIn;
+
+#else
+
+typedef struct { volatile uint32_t reg; } HostDirSet, HostDirClr, HostOutSet, HostOutClr, HostIn;
+
+#endif
+
+typedef struct { struct { uint8_t PMUXEN:1; uint8_t INEN:1; } bit; uint8_t reg; } HostPinCfg;
+typedef struct { HostDirSet DIRSET; HostDirClr DIRCLR; HostOutSet OUTSET; HostOutClr OUTCLR; HostIn IN; HostPinCfg PINCFG[32]; } PortGroup;
+typedef struct { PortGroup Group[2]; } Port;
+
+extern Port hostPort;
+#define PORT (&hostPort)
+#define PORT_PINCFG_INEN 2
+
+// All pins are on port A, g_APinDescription maps them to the port bit like on the board
+typedef struct { uint32_t ulPin; } PinDescription;
+extern PinDescription g_APinDescription[];
+#define digitalPinToPort(pin) (&PORT->Group[0])
+#define digitalPinToBitMask(pin) (1UL << g_APinDescription[pin].ulPin)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void noInterrupts(void);
+void interrupts(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+void attachInterrupt(int pin, void (*callback)(void), int mode);
+void detachInterrupt(int pin);
+int digitalPinToInterrupt(int pin);
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+
+template<class T, class U> auto min(T a, U b) -> decltype(a < b ? a : b) { return a < b ? a : b; }
+template<class T, class U> auto max(T a, U b) -> decltype(a < b ? a : b) { return a > b ? a : b; }
+
+struct HardwareSerial {
+	void begin(long baud);
+	void print(...);
+	void println(...);
+	operator bool();
+};
+extern HardwareSerial Serial;
+
+// DMAC, PM and SERCOM2 as far as the SPI transfers of FPGA.cpp use them
+typedef struct { volatile uint32_t reg; } HostRegU32;
+typedef struct { union { struct { uint8_t DMAENABLE:1; } bit; volatile uint16_t reg; } CTRL; HostRegU32 BASEADDR, WRBADDR;
+	struct { volatile uint8_t reg; } CHID, CHCTRLA, CHINTFLAG; HostRegU32 CHCTRLB; } Dmac;
+typedef struct { struct { uint16_t reg; } BTCTRL, BTCNT; HostRegU32 SRCADDR, DSTADDR, DESCADDR; } DmacDescriptor;
+typedef struct { HostRegU32 AHBMASK, APBBMASK; } Pm;
+typedef struct { struct { HostRegU32 DATA; } SPI; } Sercom;
+
+extern Dmac* DMAC;
+extern Pm* PM;
+extern Sercom* SERCOM2;
+
+#define PM_AHBMASK_DMAC 1
+#define PM_APBBMASK_DMAC 1
+#define DMAC_CTRL_DMAENABLE 2
+#define DMAC_CTRL_LVLEN(x) ((x) << 8)
+#define DMAC_CHID_ID(x) (x)
+#define DMAC_CHCTRLA_ENABLE 2
+#define DMAC_CHCTRLA_SWRST 1
+#define DMAC_CHCTRLB_LVL(x) (x)
+#define DMAC_CHCTRLB_TRIGSRC(x) ((x) << 8)
+#define DMAC_CHCTRLB_TRIGACT_BEAT (2 << 22)
+#define DMAC_CHINTFLAG_MASK 7
+#define DMAC_CHINTFLAG_TCMPL 2
+#define DMAC_BTCTRL_VALID 1
+#define DMAC_BTCTRL_BEATSIZE_BYTE 0
+#define DMAC_BTCTRL_SRCINC (1 << 10)
+#define DMAC_BTCTRL_DSTINC (1 << 11)
+#define SERCOM2_DMAC_ID_TX 6
+#define SERCOM2_DMAC_ID_RX 5
+
+#endif
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,26 @@
+//
+// Stand-in for the SPI library of the Arduino core. bridge_model.cpp connects SPI1 to the JTAG model.
+//
+
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include "Arduino.h"
+
+#define LSBFIRST 0
+#define SPI_MODE0 0
+
+struct SPISettings {
+	SPISettings(uint32_t, int, int) {}
+};
+
+struct SPIClass {
+	void begin();
+	void end();
+	void beginTransaction(SPISettings settings);
+	void endTransaction();
+	uint8_t transfer(uint8_t data);
+};
+extern SPIClass SPI1;
+
+#endif // HOST_SPI_H
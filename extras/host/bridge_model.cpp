@@ -0,0 +1,549 @@
+#include "bridge_model.h"
+#include "jtag.h"
+#include "SPI.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+
+// Pins of jtag.c on port A
+#define PIN_TDI 12
+#define PIN_TCK 13
+#define PIN_TMS 14
+#define PIN_TDO 15
+
+BridgeModel model;
+Port hostPort;
+
+static const uint8_t nextState[16][2] = {
+	/* RESET      */ { JS_RUNIDLE,    JS_RESET     },
+	/* RUNIDLE    */ { JS_RUNIDLE,    JS_SELECT_DR },
+	/* SELECT_IR  */ { JS_CAPTURE_IR, JS_RESET     },
+	/* CAPTURE_IR */ { JS_SHIFT_IR,   JS_EXIT1_IR  },
+	/* SHIFT_IR   */ { JS_SHIFT_IR,   JS_EXIT1_IR  },
+	/* EXIT1_IR   */ { JS_PAUSE_IR,   JS_UPDATE_IR },
+	/* PAUSE_IR   */ { JS_PAUSE_IR,   JS_EXIT2_IR  },
+	/* EXIT2_IR   */ { JS_SHIFT_IR,   JS_UPDATE_IR },
+	/* UPDATE_IR  */ { JS_RUNIDLE,    JS_SELECT_DR },
+	/* SELECT_DR  */ { JS_CAPTURE_DR, JS_SELECT_IR },
+	/* CAPTURE_DR */ { JS_SHIFT_DR,   JS_EXIT1_DR  },
+	/* SHIFT_DR   */ { JS_SHIFT_DR,   JS_EXIT1_DR  },
+	/* EXIT1_DR   */ { JS_PAUSE_DR,   JS_UPDATE_DR },
+	/* PAUSE_DR   */ { JS_PAUSE_DR,   JS_EXIT2_DR  },
+	/* EXIT2_DR   */ { JS_SHIFT_DR,   JS_UPDATE_DR },
+	/* UPDATE_DR  */ { JS_RUNIDLE,    JS_SELECT_DR }
+};
+
+// Hub: slave 0 is the hub itself, its data register returns the hub info and node records in nibbles
+static const int slaveBits = 2;
+static const uint32_t records[] = {
+	(3UL << 19) | ((uint32_t)JTAG_VENDOR_ID << 8) | MODEL_VIR_SIZE,			// Hub info: 3 slaves
+	((uint32_t)JTAG_ID_VJTAG << 19) | ((uint32_t)JTAG_VENDOR_ID << 8) | 0,		// JTAG_BRIDGE
+	((uint32_t)JTAG_ID_VIRTUAL << 19) | ((uint32_t)JTAG_VENDOR_ID << 8) | 0,	// jtag_interface, instance 0
+	((uint32_t)JTAG_ID_VIRTUAL << 19) | ((uint32_t)JTAG_VENDOR_ID << 8) | 1	// jtag_register_file, instance 1
+};
+
+static int state;
+static uint16_t ir, irShift;
+static uint64_t drShift;
+static int drLength;
+static int selectedSlave;
+static int nibble;
+
+// JTAG_BRIDGE
+static uint32_t bridgeIR;
+static uint32_t address, dataShift;
+static int bitCount;				// Bits since the start of the address or the last word
+static bool addressPhase;
+static uint32_t burstCount = 1;
+static uint32_t readFifo[JBC_MAX_READ_BURST];
+static int readLevel;
+static uint32_t burstAddress;
+
+// jtag_interface, instruction { operation, single access, write index, read index } of jtag_memory.v
+#define ADDRESS_WIDTH 2
+#define NEG_ONE 3
+#define OP_SET 1
+#define OP_CLEAR 2
+#define OP_TOGGLE 3
+#define OP_ADD 4
+#define OP_CHANGES 6
+#define OP_STATUS 7
+#define BUILD_HASH 0x4D4F444CUL
+
+static const uint8_t interfaceDescriptor[12 + MODEL_REGISTERS * 2] = {
+	MODEL_REGISTERS, 32, 4, 0x1F,		// Registers, width, version, burst, widths, atomic and both FIFO types
+	BUILD_HASH & 0xFF, (BUILD_HASH >> 8) & 0xFF, (BUILD_HASH >> 16) & 0xFF, BUILD_HASH >> 24,
+	0, 0, 0, 1,							// No extended features, timestamps or banks
+	32, 0x03, 32, 0x03 | 0x04, 32, 0x03 | 0x08
+};
+static uint32_t interfaceShift;
+static int descriptorBit;
+static int interfaceBurst;
+static bool outputAccepted;
+
+// jtag_register_file, instruction { write, address } of jtag_ram.v
+#define RAM_ADDRESS_WIDTH 7
+
+static const uint8_t ramDescriptor[16] = {
+	0, MODEL_RAM_WIDTH, 4, 0x01,		// No registers, width, version, burst
+	0, 0, 0, 0,
+	0x04, 0, 0, 0,						// Register file
+	MODEL_RAM_WORDS, 0, 0, 0
+};
+static uint32_t ramInstruction;
+static uint32_t ramShift;
+static int ramBurst;
+
+static uint32_t pins;
+static int tdoHigh;					// TDO while TCK is high, it only changes on the falling edge
+
+static void protocolError(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	vsnprintf(model.lastError, sizeof(model.lastError), format, args);
+	va_end(args);
+	model.errors++;
+}
+
+static void avalonWrite(uint32_t wordAddress, uint32_t data) {
+	// Only the first beat of a burst carries the address
+	if (model.burstLeft == 0) {
+		burstAddress = wordAddress;
+		model.burstLeft = burstCount;
+	}
+	else {
+		burstAddress++;
+	}
+	model.burstLeft--;
+
+	if (burstAddress < MODEL_MEMORY_WORDS) model.memory[burstAddress] = data;
+	else protocolError("write to 0x%X outside of the memory", burstAddress);
+}
+
+static void avalonRead(uint32_t wordAddress) {
+	if (model.burstLeft != 0) {
+		protocolError("read burst while a write burst still expects %d beats", model.burstLeft);
+		return;
+	}
+	if (burstCount > JBC_MAX_READ_BURST) {
+		protocolError("read burst of %u words overflows the read FIFO", burstCount);
+		return;
+	}
+
+	readLevel = 0;
+	for (uint32_t i = 0; i < burstCount; i++) {
+		uint32_t a = wordAddress + i;
+		readFifo[readLevel++] = (a < MODEL_MEMORY_WORDS) ? model.memory[a] : 0;
+	}
+}
+
+static uint32_t popReadFifo() {
+	// Reading past the burst returns stale data, like the dcfifo with underflow checking
+	if (readLevel == 0) return 0xFFFFFFFF;
+	uint32_t word = readFifo[0];
+	readLevel--;
+	for (int i = 0; i < readLevel; i++) readFifo[i] = readFifo[i + 1];
+	return word;
+}
+
+static void bridgeCapture() {
+	bitCount = 0;
+	if (bridgeIR == JBC_WRITE) {
+		addressPhase = true;
+		dataShift = 0;
+	}
+	else {
+		dataShift = popReadFifo();
+	}
+}
+
+static void bridgeShift(int tdi) {
+	if (bridgeIR == JBC_WRITE) {
+		dataShift = (dataShift >> 1) | ((uint32_t)tdi << 31);
+		if (++bitCount < 32) return;
+		bitCount = 0;
+
+		if (addressPhase) {
+			if ((dataShift & 3) != 3) protocolError("address phase with %u address bytes", (dataShift & 3) + 1);
+			address = dataShift >> 2;
+			addressPhase = false;
+		}
+		else {
+			avalonWrite(address++, dataShift);
+		}
+	}
+	else {
+		if (++bitCount < 32) {
+			dataShift >>= 1;
+			return;
+		}
+		bitCount = 0;
+		dataShift = popReadFifo();
+	}
+}
+
+static void bridgeUpdate() {
+	if (bridgeIR != JBC_WRITE) return;
+
+	// The burst count only changes with an Update-DR, exactly 4 bits after the address set it
+	burstCount = (!addressPhase && bitCount == 4) ? (dataShift >> 28) + 1 : 1;
+	addressPhase = false;
+}
+
+static int descriptorTDO(const uint8_t* descriptor, int size) {
+	return (descriptorBit < size * 8) ? (descriptor[descriptorBit / 8] >> (descriptorBit % 8)) & 1 : 0;
+}
+
+static uint32_t fifoStatus(ModelFifo& fifo, bool output) {
+	uint32_t status = ((uint32_t)(output ? MODEL_FIFO_DEPTH - fifo.level : fifo.level) << 1) | fifo.flag;
+	fifo.flag = false;		// Cleared by the status read
+	return status;
+}
+
+static uint32_t fifoPop(ModelFifo& fifo) {
+	uint32_t value = fifo.entries[0];
+	fifo.level--;
+	for (int i = 0; i < fifo.level; i++) fifo.entries[i] = fifo.entries[i + 1];
+	return value;
+}
+
+static void fifoPush(ModelFifo& fifo, uint32_t value) {
+	if (fifo.level == MODEL_FIFO_DEPTH) {
+		fifo.flag = true;
+		return;
+	}
+	fifo.entries[fifo.level++] = value;
+}
+
+static void decodeInterface(int& readIndex, int& writeIndex, int& operation, bool& burst) {
+	uint32_t readAddress = model.interfaceInstruction & NEG_ONE;
+	uint32_t writeAddress = (model.interfaceInstruction >> ADDRESS_WIDTH) & NEG_ONE;
+	burst = !((model.interfaceInstruction >> (ADDRESS_WIDTH * 2)) & 1);
+	operation = model.interfaceInstruction >> (ADDRESS_WIDTH * 2 + 1);
+	readIndex = (readAddress == NEG_ONE) ? -1 : (int)readAddress + (burst ? interfaceBurst : 0);
+	writeIndex = (writeAddress == NEG_ONE) ? -1 : (int)writeAddress + (burst ? interfaceBurst : 0);
+}
+
+static bool interfaceIdRequested() {
+	int readIndex, writeIndex, operation;
+	bool burst;
+	decodeInterface(readIndex, writeIndex, operation, burst);
+	return readIndex < 0 && writeIndex < 0 && operation != OP_CHANGES;
+}
+
+static void interfaceCapture() {
+	int readIndex, writeIndex, operation;
+	bool burst;
+	decodeInterface(readIndex, writeIndex, operation, burst);
+	bool readValid = readIndex >= 0 && readIndex < MODEL_REGISTERS;
+
+	if (interfaceIdRequested()) {
+		descriptorBit = 0;
+	}
+	else if (operation == OP_STATUS && writeIndex == MODEL_OUTPUT_STREAM) {
+		// Stream write: the value is only taken if the captured status had space
+		outputAccepted = model.outputFifo.level < MODEL_FIFO_DEPTH;
+		interfaceShift = fifoStatus(model.outputFifo, true);
+	}
+	else if (operation == OP_STATUS && readIndex == MODEL_OUTPUT_STREAM) {
+		interfaceShift = fifoStatus(model.outputFifo, true);
+	}
+	else if (operation == OP_STATUS && readIndex == MODEL_STREAM) {
+		interfaceShift = fifoStatus(model.inputFifo, false);
+	}
+	else if (readValid && readIndex == MODEL_STREAM) {
+		if (model.inputFifo.level > 0) {
+			interfaceShift = fifoPop(model.inputFifo);
+		}
+		else {
+			interfaceShift = 0;
+			model.emptyCaptures++;
+		}
+	}
+	else if (readValid) {
+		interfaceShift = model.inputs[readIndex];
+	}
+	else {
+		interfaceShift = 0;
+	}
+}
+
+static void interfaceShiftBit(int tdi) {
+	interfaceShift = (interfaceShift >> 1) | ((uint32_t)tdi << 31);
+	descriptorBit++;
+}
+
+static int interfaceTDO() {
+	if (interfaceIdRequested()) return descriptorTDO(interfaceDescriptor, sizeof(interfaceDescriptor));
+	return interfaceShift & 1;
+}
+
+static void interfaceUpdate() {
+	int readIndex, writeIndex, operation;
+	bool burst;
+	decodeInterface(readIndex, writeIndex, operation, burst);
+	bool streamWrite = operation == OP_STATUS && writeIndex == MODEL_OUTPUT_STREAM;
+
+	if (writeIndex >= 0 && writeIndex < MODEL_REGISTERS && (!streamWrite || outputAccepted)) {
+		uint32_t& value = model.outputs[writeIndex];
+		switch (operation) {
+		case OP_SET:	value |= interfaceShift; break;
+		case OP_CLEAR:	value &= ~interfaceShift; break;
+		case OP_TOGGLE:	value ^= interfaceShift; break;
+		case OP_ADD:	value += interfaceShift; break;
+		default:		value = interfaceShift; break;
+		}
+		if (writeIndex == MODEL_OUTPUT_STREAM) fifoPush(model.outputFifo, value);
+	}
+	if (burst) interfaceBurst++;
+}
+
+static bool ramIdRequested() {
+	return ramInstruction == (1UL << (RAM_ADDRESS_WIDTH + 1)) - 1;
+}
+
+static uint32_t ramIndex() {
+	return (ramInstruction & ((1UL << RAM_ADDRESS_WIDTH) - 1)) + ramBurst;
+}
+
+static void ramCapture() {
+	if (ramIdRequested()) descriptorBit = 0;
+	else ramShift = (ramIndex() < MODEL_RAM_WORDS) ? model.ram[ramIndex()] : 0;
+}
+
+static void ramShiftBit(int tdi) {
+	ramShift = (ramShift >> 1) | ((uint32_t)tdi << (MODEL_RAM_WIDTH - 1));
+	descriptorBit++;
+}
+
+static int ramTDO() {
+	if (ramIdRequested()) return descriptorTDO(ramDescriptor, sizeof(ramDescriptor));
+	return ramShift & 1;
+}
+
+static void ramUpdate() {
+	bool write = (ramInstruction >> RAM_ADDRESS_WIDTH) & 1;
+	if (write && !ramIdRequested() && ramIndex() < MODEL_RAM_WORDS) model.ram[ramIndex()] = ramShift;
+	ramBurst++;
+}
+
+static void captureDR() {
+	switch (ir) {
+	case JI_USER1_VIR:
+		drShift = 0;
+		drLength = slaveBits + MODEL_VIR_SIZE;
+		break;
+	case JI_USER0_VDR:
+		if (selectedSlave == 0) {
+			drShift = (records[nibble / 8] >> (4 * (nibble % 8))) & 0xF;
+			drLength = 4;
+			if (nibble < (int)(sizeof(records) / sizeof(records[0])) * 8 - 1) nibble++;
+		}
+		else if (selectedSlave == MODEL_BRIDGE_SLAVE) {
+			bridgeCapture();
+		}
+		else if (selectedSlave == MODEL_INTERFACE_SLAVE) {
+			interfaceCapture();
+		}
+		else {
+			ramCapture();
+		}
+		break;
+	case JI_CHECK_STATUS:
+		drShift = ~0ULL;		// CONF_DONE and everything else high
+		drLength = 0;
+		break;
+	default:
+		drShift = 0;			// BYPASS
+		drLength = 1;
+		break;
+	}
+}
+
+static void shiftDR(int tms, int tdi) {
+	if (ir == JI_USER0_VDR && selectedSlave == MODEL_BRIDGE_SLAVE) {
+		bridgeShift(tdi);
+	}
+	else if (ir == JI_USER0_VDR && selectedSlave == MODEL_INTERFACE_SLAVE) {
+		if (!tms) interfaceShiftBit(tdi);		// See the header about the clock leaving Shift-DR
+	}
+	else if (ir == JI_USER0_VDR && selectedSlave == MODEL_RAM_SLAVE) {
+		if (!tms) ramShiftBit(tdi);
+	}
+	else if (drLength > 0) {
+		drShift = (drShift >> 1) | ((uint64_t)tdi << (drLength - 1));
+	}
+}
+
+static void updateDR() {
+	if (ir == JI_USER1_VIR) {
+		uint32_t vir = (uint32_t)drShift;
+		selectedSlave = vir >> MODEL_VIR_SIZE;
+		uint32_t instruction = vir & ((1UL << MODEL_VIR_SIZE) - 1);
+
+		if (selectedSlave == 0) {
+			nibble = 0;
+		}
+		else if (selectedSlave == MODEL_BRIDGE_SLAVE) {
+			bridgeIR = instruction & 7;
+			if (bridgeIR == JBC_READ) avalonRead(address);	// Update-IR of the bridge issues the read
+		}
+		else if (selectedSlave == MODEL_INTERFACE_SLAVE) {
+			model.interfaceInstruction = instruction;
+			interfaceBurst = 0;		// Update-IR of the slave
+		}
+		else {
+			ramInstruction = instruction;
+			ramBurst = 0;
+			model.ramInstructions++;
+		}
+	}
+	else if (ir == JI_USER0_VDR) {
+		if (selectedSlave == MODEL_BRIDGE_SLAVE) bridgeUpdate();
+		else if (selectedSlave == MODEL_INTERFACE_SLAVE) interfaceUpdate();
+		else if (selectedSlave == MODEL_RAM_SLAVE) ramUpdate();
+	}
+}
+
+void modelReset() {
+	memset(&model, 0, sizeof(model));
+	state = JS_RESET;
+	ir = JI_IDCODE;
+	selectedSlave = 0;
+	nibble = 0;
+	bridgeIR = JBC_WRITE;
+	burstCount = 1;
+	readLevel = 0;
+	addressPhase = false;
+	interfaceBurst = 0;
+	ramInstruction = 0;
+	ramBurst = 0;
+	pins = 0;
+}
+
+void modelClock(int tms, int tdi) {
+	// Capture and shift happen on the rising edge that leaves the state
+	switch (state) {
+	case JS_CAPTURE_IR:	irShift = 0x155; break;
+	case JS_SHIFT_IR:	irShift = (irShift >> 1) | ((uint16_t)tdi << (INST_LEN - 1)); break;
+	case JS_CAPTURE_DR:	captureDR(); break;
+	case JS_SHIFT_DR:	shiftDR(tms, tdi); break;
+	default: break;
+	}
+	state = nextState[state][tms ? 1 : 0];
+
+	// Reset and update happen on the falling edge in the state
+	switch (state) {
+	case JS_RESET:		ir = JI_IDCODE; break;		// The hub keeps its selection
+	case JS_UPDATE_IR:	ir = irShift & ((1 << INST_LEN) - 1); break;
+	case JS_UPDATE_DR:	updateDR(); break;
+	default: break;
+	}
+}
+
+int modelTDO() {
+	if (state == JS_SHIFT_IR) return irShift & 1;
+	if (state != JS_SHIFT_DR) return 0;
+	if (ir == JI_USER0_VDR && selectedSlave == MODEL_BRIDGE_SLAVE) return dataShift & 1;
+	if (ir == JI_USER0_VDR && selectedSlave == MODEL_INTERFACE_SLAVE) return interfaceTDO();
+	if (ir == JI_USER0_VDR && selectedSlave == MODEL_RAM_SLAVE) return ramTDO();
+	return drShift & 1;
+}
+
+void modelPushSample(uint32_t value) {
+	fifoPush(model.inputFifo, value);
+}
+
+bool modelPopOutput(uint32_t* value) {
+	if (model.outputFifo.level == 0) {
+		model.outputFifo.flag = true;
+		return false;
+	}
+	*value = fifoPop(model.outputFifo);
+	return true;
+}
+
+void modelForeignInstruction(uint32_t value) {
+	static const int path[] = { 1, 1, 1, 1, 1, 0, 1, 1, 0, 0 };		// Any state to SHIFT-IR
+	int length = slaveBits + MODEL_VIR_SIZE;
+
+	for (int i = 0; i < 10; i++) modelClock(path[i], 0);
+	for (int i = 0; i < INST_LEN; i++) modelClock(i == INST_LEN - 1, (JI_USER1_VIR >> i) & 1);
+	modelClock(1, 0);		// UPDATE-IR
+	modelClock(1, 0);		// SELECT-DR
+	modelClock(0, 0);		// CAPTURE-DR
+	modelClock(0, 0);		// SHIFT-DR
+	for (int i = 0; i < length; i++) modelClock(i == length - 1, (value >> i) & 1);
+	for (int i = 0; i < 5; i++) modelClock(1, 0);		// Through UPDATE-DR to Test-Logic-Reset
+}
+
+// Pins of the Arduino core
+
+void hostPortWrite(int reg, uint32_t mask) {
+	uint32_t previous = pins;
+	if (reg == HOST_OUTSET) pins |= mask;
+	else if (reg == HOST_OUTCLR) pins &= ~mask;
+	else return;
+
+	if (!(previous & (1UL << PIN_TCK)) && (pins & (1UL << PIN_TCK))) {
+		tdoHigh = modelTDO();
+		modelClock((pins >> PIN_TMS) & 1, (pins >> PIN_TDI) & 1);
+	}
+}
+
+uint32_t hostPortRead() {
+	int tdo = (pins & (1UL << PIN_TCK)) ? tdoHigh : modelTDO();
+	return (uint32_t)tdo << PIN_TDO;
+}
+
+// The JTAG pins 26 to 29 of FPGA.cpp are PA12 to PA15, the pins of jtag.c
+PinDescription g_APinDescription[34] = {
+	{ 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 },
+	{ 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 },
+	{ PIN_TDI }, { PIN_TCK }, { PIN_TMS }, { PIN_TDO }, { 0 }, { 0 }, { 0 }, { 0 }
+};
+
+// SPI1 shifts 8 bits, LSB first, on TCK and TDI while they are multiplexed to the SERCOM. TMS stays where
+// FPGA.cpp left it, TDI too if only TCK and TDO are multiplexed (FPGA.pulseTDO()).
+SPIClass SPI1;
+
+uint8_t SPIClass::transfer(uint8_t data) {
+	uint8_t in = 0;
+	bool tdiMuxed = hostPort.Group[0].PINCFG[PIN_TDI].bit.PMUXEN;
+	for (int bit = 0; bit < 8; bit++) {
+		in |= modelTDO() << bit;
+		modelClock((pins >> PIN_TMS) & 1, tdiMuxed ? (data >> bit) & 1 : (pins >> PIN_TDI) & 1);
+	}
+	return in;
+}
+
+void SPIClass::begin() {}
+void SPIClass::end() {}
+void SPIClass::beginTransaction(SPISettings) {}
+void SPIClass::endTransaction() {}
+
+// Nothing interrupts the model, and the DMA controller stays with polled SPI (dmaAvailable is only set
+// when FPGA.cpp attaches the bridge, which the tests of FPGA.cpp don't use)
+static Dmac hostDmac;
+static Pm hostPm;
+static Sercom hostSercom;
+Dmac* DMAC = &hostDmac;
+Pm* PM = &hostPm;
+Sercom* SERCOM2 = &hostSercom;
+
+extern "C" {
+void pinMode(int, int) {}
+void digitalWrite(int, int) {}
+int digitalRead(int) { return 0; }
+unsigned long millis(void) { return 0; }
+unsigned long micros(void) { return 0; }
+void delay(unsigned long) {}
+void delayMicroseconds(unsigned int) {}
+void noInterrupts(void) {}
+void interrupts(void) {}
+uint32_t __get_PRIMASK(void) { return 0; }
+void __set_PRIMASK(uint32_t) {}
+void attachInterrupt(int, void (*)(void), int) {}
+void detachInterrupt(int) {}
+int digitalPinToInterrupt(int pin) { return pin; }
+}
@@ -0,0 +1,109 @@
+//
+// Host model of the JTAG chain as src/jtag.c and src/FPGA.cpp see it: the TAP of the Cyclone 10, the virtual
+// JTAG hub with three slaves, the JTAG_BRIDGE (FPGA/ip/JTAG_BRIDGE) with an Avalon memory behind it, a
+// jtag_interface with FIFO registers and a jtag_register_file.
+//
+// The bridge is modelled on the level of its protocol, not cycle by cycle:
+//
+//   VIR 0 (write): Capture-DR starts the address phase. The first 32 bits are the word address << 2 | 3,
+//     every further 32 bits are written to the next address. Update-DR sets the burst count of the
+//     Avalon commands: to the 4 bits after the address + 1 if exactly 4 bits followed it, otherwise to 1.
+//     The count is kept until the next Update-DR, also across a switch of the VIR.
+//   VIR 1 (read): selecting it issues an Avalon read burst of burst count words at the address into the
+//     read FIFO (JBC_MAX_READ_BURST deep). Capture-DR loads the first word, every 32 bits the next one.
+//
+// The Avalon slave takes the address of a write burst with its first beat only, the following beats go
+// to the next addresses, whatever address the bridge sends along. A write with a stale burst count
+// therefore shows up as words at the wrong address, or as a burst left open.
+//
+// jtag_interface (instance 0) has MODEL_REGISTERS registers of 32 bits: register 0 is a plain register,
+//   register 1 is in FIFO_REGISTERS and register 2 in OUTPUT_FIFO_REGISTERS, both MODEL_FIFO_DEPTH deep.
+//   The instruction and the scans follow jtag_memory.v. A FIFO status captured after a push or a pop already
+//   counts it, jtag_fifo_tb.v checks that the synchronizers of jtag_fifo.v settle between two scans.
+// jtag_register_file (instance 1) has MODEL_RAM_WORDS words of MODEL_RAM_WIDTH bits and follows jtag_ram.v:
+//   the instruction is { write, address }, every Update-DR advances the address, an Update-IR of the slave
+//   restarts at the address of the instruction. All instruction bits set shift out the descriptor.
+//
+// jtag.c and FPGA.cpp both clock every bit of a data scan and leave Shift-DR with one more clock. The bridge
+// takes that clock as a shift, jtag.c relies on it for the last bit of the burst count. The two slaves above
+// only take the clocked bits, which is what FPGA.cpp and the testbenches of jtag_memory.v and jtag_ram.v
+// assume. The model does not tell which of the two the hub of the Cyclone 10 actually does.
+//
+// SPIClass::transfer() clocks the model 8 times while the pins are multiplexed to the SERCOM, like the SPI
+// of FPGA.cpp. TDO changes on the falling edge of TCK, so it reads the same before and after a rising edge.
+//
+
+#ifndef BRIDGE_MODEL_H
+#define BRIDGE_MODEL_H
+
+#include <stdint.h>
+
+#define MODEL_MEMORY_WORDS 1024
+#define MODEL_VIR_SIZE 8			// Widest virtual IR of the slaves
+#define MODEL_BRIDGE_SLAVE 1		// Slave select value of the JTAG_BRIDGE
+#define MODEL_INTERFACE_SLAVE 2		// Slave select value of the jtag_interface
+#define MODEL_RAM_SLAVE 3			// Slave select value of the jtag_register_file
+
+#define MODEL_REGISTERS 3
+#define MODEL_STREAM 1				// Index of the FIFO register
+#define MODEL_OUTPUT_STREAM 2		// Index of the output FIFO register
+#define MODEL_FIFO_DEPTH 8
+#define MODEL_RAM_WORDS 100
+#define MODEL_RAM_WIDTH 24
+
+struct ModelFifo {
+	uint32_t entries[MODEL_FIFO_DEPTH];
+	int level;
+	bool flag;						// Overflow (input) or underrun (output) since the last status read
+};
+
+struct BridgeModel {
+	uint32_t memory[MODEL_MEMORY_WORDS];	// Avalon memory behind the bridge
+	uint32_t interfaceInstruction;	// Virtual IR of the jtag_interface
+	uint32_t inputs[MODEL_REGISTERS];	// Values of the FPGA design, captured by reads
+	uint32_t outputs[MODEL_REGISTERS];	// Last written values
+	ModelFifo inputFifo;			// Of register MODEL_STREAM
+	ModelFifo outputFifo;			// Of register MODEL_OUTPUT_STREAM
+	int emptyCaptures;				// Entries captured from the empty input FIFO
+	uint32_t ram[MODEL_RAM_WORDS];	// Words of the jtag_register_file
+	int ramInstructions;			// Update-IRs of the jtag_register_file
+	int errors;						// Protocol violations, see lastError
+	char lastError[128];
+	int burstLeft;					// Beats still expected by an open Avalon write burst
+};
+
+extern BridgeModel model;
+
+///
+/// @brief Clears the memory and puts the TAP into Test-Logic-Reset.
+///
+void modelReset();
+
+///
+/// @brief One rising edge of TCK, with the values of TMS and TDI before it.
+///
+void modelClock(int tms, int tdi);
+
+///
+/// @brief The value of TDO before the next rising edge of TCK.
+///
+int modelTDO();
+
+///
+/// @brief Pushes a sample into the input FIFO from the FPGA side. A full FIFO drops it and sets the flag.
+///
+void modelPushSample(uint32_t value);
+
+///
+/// @brief Takes the oldest entry of the output FIFO on the FPGA side. An empty FIFO sets the flag.
+/// @return bool - false if the FIFO was empty.
+///
+bool modelPopOutput(uint32_t* value);
+
+///
+/// @brief Scans value into the virtual IR of the hub like FPGA.cpp does for a register access, from any
+/// TAP state to Test-Logic-Reset. jtag.c does not see it.
+///
+void modelForeignInstruction(uint32_t value);
+
+#endif // BRIDGE_MODEL_H
@@ -0,0 +1,164 @@
+//
+// Replays the access sequences of FPGA.cpp through src/jtag.c against the model of bridge_model.cpp and
+// checks the memory behind the JTAG_BRIDGE. Run with test_bridge.sh.
+//
+
+#include "bridge_model.h"
+#include "jtag.h"
+
+#include <stdio.h>
+
+static int failures;
+
+static void check(bool condition, const char* name) {
+	if (condition && model.errors == 0) {
+		printf("PASS  %s\n", name);
+		return;
+	}
+	printf("FAIL  %s", name);
+	if (model.errors) printf(": %s", model.lastError);
+	printf("\n");
+	failures++;
+}
+
+static void fill(uint32_t* data, size_t len, uint32_t seed) {
+	for (size_t i = 0; i < len; i++) data[i] = seed * 0x01000193 + i * 0x9E3779B9;
+}
+
+static bool memoryEquals(uint32_t address, const uint32_t* data, size_t len) {
+	return memcmp(&model.memory[address], data, len * 4) == 0;
+}
+
+// Data shifted by the DMA engine of FPGA.cpp, which clocks without jtag.c seeing it
+static void shiftWords(const uint32_t* src, uint32_t* dst, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		uint32_t in = 0;
+		for (int bit = 0; bit < 32; bit++) {
+			in |= (uint32_t)modelTDO() << bit;
+			modelClock(0, src ? (src[i] >> bit) & 1 : 0);
+		}
+		if (dst) dst[i] = in;
+	}
+}
+
+static void testInit() {
+	modelReset();
+	check(jtagInit() == 0, "jtagInit finds the JTAG_BRIDGE");
+}
+
+static void testWriteV() {
+	uint32_t a[5], b[3], c[2];
+	fill(a, 5, 1);
+	fill(b, 3, 2);
+	fill(c, 2, 3);
+	jtagSegment segments[] = {
+		{ 0x10, (uint8_t*)a, 5 },
+		{ 0x15, (uint8_t*)b, 3 },		// Continues the scan of a
+		{ 0x40, (uint8_t*)c, 2 }
+	};
+
+	check(jtagWriteBufferV(segments, 3) == 10 && memoryEquals(0x10, a, 5) && memoryEquals(0x15, b, 3) &&
+		memoryEquals(0x40, c, 2), "jtagWriteBufferV with a contiguous and a separate segment");
+}
+
+static void testReadV() {
+	uint32_t a[3], b[6];
+	jtagSegment segments[] = {
+		{ 0x10, (uint8_t*)a, 3 },
+		{ 0x12, (uint8_t*)b, 6 }		// Two bursts
+	};
+
+	check(jtagReadBufferV(segments, 2) == 9 && memoryEquals(0x10, a, 3) && memoryEquals(0x12, b, 6),
+		"jtagReadBufferV in bursts of up to JBC_MAX_READ_BURST words");
+}
+
+static void testReadThenWrite() {
+	uint32_t buffer[JBC_MAX_READ_BURST];
+	jtagSegment read = { 0x20, (uint8_t*)buffer, JBC_MAX_READ_BURST };
+	jtagReadBufferV(&read, 1);
+
+	// Two one-word segments, a stale burst count of the read would keep the Avalon burst open
+	uint32_t x = 0x11111111, y = 0x22222222;
+	jtagSegment segments[] = {
+		{ 0x80, (uint8_t*)&x, 1 },
+		{ 0x90, (uint8_t*)&y, 1 }
+	};
+	jtagWriteBufferV(segments, 2);
+
+	check(model.memory[0x80] == x && model.memory[0x90] == y && model.burstLeft == 0,
+		"jtagWriteBufferV after a read burst");
+}
+
+static void testForeignInstruction() {
+	uint32_t a[2], b[2];
+	fill(a, 2, 4);
+	fill(b, 2, 5);
+	jtagSegment first = { 0x100, (uint8_t*)a, 2 };
+	jtagSegment second = { 0x108, (uint8_t*)b, 2 };
+
+	jtagWriteBufferV(&first, 1);
+
+	// A register access of FPGA.cpp selects another slave and leaves the TAP in Test-Logic-Reset
+	modelForeignInstruction((MODEL_INTERFACE_SLAVE << MODEL_VIR_SIZE) | 3);
+	jtagInvalidateVIR();
+
+	jtagWriteBufferV(&second, 1);
+
+	check(memoryEquals(0x100, a, 2) && memoryEquals(0x108, b, 2) && model.interfaceInstruction == 3,
+		"jtagWriteBufferV after a register access of another slave");
+}
+
+static void testPreemptedCopy() {
+	uint32_t data[11];
+	fill(data, 11, 6);
+
+	// copyToFPGA() after a read, with a register access between its chunks
+	uint32_t buffer[3];
+	jtagSegment read = { 0x10, (uint8_t*)buffer, 3 };
+	jtagReadBufferV(&read, 1);
+
+	jtagBeginWrite(0x200);
+	shiftWords(data, nullptr, 7);
+	jtagEndTransfer();
+	bool closed = model.burstLeft == 0;
+
+	modelForeignInstruction((MODEL_INTERFACE_SLAVE << MODEL_VIR_SIZE) | 1);
+	jtagInvalidateVIR();
+
+	jtagBeginWrite(0x207);
+	shiftWords(data + 7, nullptr, 4);
+	jtagEndTransfer();
+
+	check(memoryEquals(0x200, data, 11) && closed && model.burstLeft == 0,
+		"copyToFPGA sequence after a read, with a preemption");
+}
+
+static void testBeginRead() {
+	uint32_t data[10], expected[10];
+	fill(expected, 10, 7);
+	memcpy(&model.memory[0x300], expected, sizeof(expected));
+
+	// copyFromFPGA() in bursts of JBC_MAX_READ_BURST words
+	bool ok = true;
+	for (size_t done = 0; done < 10; done += JBC_MAX_READ_BURST) {
+		size_t n = (10 - done < JBC_MAX_READ_BURST) ? 10 - done : JBC_MAX_READ_BURST;
+		ok = ok && jtagBeginRead(0x300 + done, n) == 0;
+		shiftWords(nullptr, data + done, n);
+		jtagEndTransfer();
+	}
+
+	check(ok && memcmp(data, expected, sizeof(data)) == 0, "copyFromFPGA sequence");
+}
+
+int main() {
+	testInit();
+	testWriteV();
+	testReadV();
+	testReadThenWrite();
+	testForeignInstruction();
+	testPreemptedCopy();
+	testBeginRead();
+
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+# Compiles the library sources and the example sketches against the stand-ins for the Arduino core in
+# this folder, to catch errors and warnings without the Arduino toolchain. Each file is compiled but
+# nothing is linked or run. Any warning fails the check, except in jtag.c, upload.cpp and the simple
+# example, whose warnings come from the original sources and are only printed.
+#
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT="$HERE/../.."
+FLAGS="-c -o /dev/null -Wall -Wextra -DARDUINO_SAMD_MKRVIDOR4000 -I$HERE -I$ROOT/src"
+FAILED=0
+
+strict() {
+	case "$(basename "$1")" in
+		jtag.c|upload.cpp|simple.ino) ;;
+		*) echo "-Werror" ;;
+	esac
+}
+
+for f in "$ROOT"/src/*.cpp; do
+	g++ -std=gnu++11 $FLAGS $(strict "$f") "$f" || FAILED=1
+done
+for f in "$ROOT"/src/*.c; do
+	gcc -std=gnu11 $FLAGS $(strict "$f") "$f" || FAILED=1
+done
+
+# The Arduino IDE includes Arduino.h into every sketch
+for f in "$ROOT"/examples/*/*.ino; do
+	g++ -std=gnu++11 $FLAGS $(strict "$f") -include Arduino.h -x c++ "$f" || FAILED=1
+done
+
+if [ $FAILED -ne 0 ]; then
+	echo "FAILED"
+	exit 1
+fi
+echo "OK"
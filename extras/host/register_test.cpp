@@ -0,0 +1,148 @@
+//
+// Runs the register functions of src/FPGA.cpp and src/FPGARegisterFile.cpp through the SPI and the pins of the
+// Arduino core against the model of bridge_model.cpp and checks what arrives in the jtag_interface and the
+// jtag_register_file. Run with test_registers.sh.
+//
+
+#include "bridge_model.h"
+#include "FPGA.h"
+#include "FPGARegisterFile.h"
+
+#include <stdio.h>
+
+static int failures;
+
+static void check(bool condition, const char* name) {
+	if (condition && model.errors == 0) {
+		printf("PASS  %s\n", name);
+		return;
+	}
+	printf("FAIL  %s", name);
+	if (model.errors) printf(": %s", model.lastError);
+	printf("\n");
+	failures++;
+}
+
+// Nothing to upload, the model is the bitstream
+void enableFpgaClock(void) {}
+void __uploadBitstream() {}
+
+static void testBegin() {
+	modelReset();
+	bool ok = FPGA.begin();
+	if (!ok) printf("      %s\n", FPGA.getErrorMessage());
+	check(ok && FPGA.getModuleInfo().buildHash == 0x4D4F444C &&
+		(FPGA.getRegisterDirection(MODEL_STREAM) & FPGA_REGISTER_STREAM) &&
+		(FPGA.getRegisterDirection(MODEL_OUTPUT_STREAM) & FPGA_REGISTER_OUTPUT_STREAM),
+		"FPGA.begin() reads the descriptor of the jtag_interface");
+}
+
+static void testReadStream() {
+	for (int i = 0; i < 5; i++) modelPushSample(100 + i);
+
+	int64_t values[MODEL_FIFO_DEPTH] = { 0 };
+	bool overflow = true;
+	int n = FPGA.readStream(MODEL_STREAM, values, 3, &overflow);
+	bool ok = n == 3 && !overflow && values[0] == 100 && values[1] == 101 && values[2] == 102;
+
+	// The rest, and nothing captured from the empty FIFO
+	n = FPGA.readStream(MODEL_STREAM, values, MODEL_FIFO_DEPTH, &overflow);
+	ok = ok && n == 2 && values[0] == 103 && values[1] == 104;
+	n = FPGA.readStream(MODEL_STREAM, values, MODEL_FIFO_DEPTH, &overflow);
+	check(ok && n == 0 && model.inputFifo.level == 0 && model.emptyCaptures == 0,
+		"readStream reads every entry once, oldest first");
+
+	// A full FIFO drops samples, the flag is reported once
+	for (int i = 0; i < MODEL_FIFO_DEPTH + 3; i++) modelPushSample(200 + i);
+	n = FPGA.readStream(MODEL_STREAM, values, MODEL_FIFO_DEPTH, &overflow);
+	ok = n == MODEL_FIFO_DEPTH && overflow && values[0] == 200 && values[MODEL_FIFO_DEPTH - 1] == 200 + MODEL_FIFO_DEPTH - 1;
+	n = FPGA.readStream(MODEL_STREAM, values, MODEL_FIFO_DEPTH, &overflow);
+	check(ok && n == 0 && !overflow && model.emptyCaptures == 0, "readStream reports an overflow once");
+
+	check(FPGA.readStream(0, values, 1) == -1 && FPGA.readStream(MODEL_OUTPUT_STREAM, values, 1) == -1,
+		"readStream rejects registers without an input FIFO");
+}
+
+static void testWriteStream() {
+	int64_t values[MODEL_FIFO_DEPTH + 4];
+	for (int i = 0; i < MODEL_FIFO_DEPTH + 4; i++) values[i] = 300 + i;
+
+	// Writing stops where the FIFO is full
+	bool underrun = true;
+	int n = FPGA.writeStream(MODEL_OUTPUT_STREAM, values, MODEL_FIFO_DEPTH + 4, &underrun);
+	bool ok = n == MODEL_FIFO_DEPTH && !underrun && model.outputFifo.level == MODEL_FIFO_DEPTH;
+	ok = ok && FPGA.writeStream(MODEL_OUTPUT_STREAM, values + n, 4, &underrun) == 0;
+
+	uint32_t value;
+	for (int i = 0; i < MODEL_FIFO_DEPTH; i++) ok = ok && modelPopOutput(&value) && value == (uint32_t)(300 + i);
+	check(ok, "writeStream stops at a full FIFO and keeps the order");
+
+	// The rest goes in once the FPGA side took the FIFO empty
+	n = FPGA.writeStream(MODEL_OUTPUT_STREAM, values + MODEL_FIFO_DEPTH, 4, &underrun);
+	ok = n == 4 && !underrun;
+	for (int i = 0; i < 4; i++) ok = ok && modelPopOutput(&value) && value == (uint32_t)(300 + MODEL_FIFO_DEPTH + i);
+	ok = ok && !modelPopOutput(&value);
+	n = FPGA.writeStream(MODEL_OUTPUT_STREAM, values, 1, &underrun);
+	ok = ok && n == 1 && underrun;
+	n = FPGA.writeStream(MODEL_OUTPUT_STREAM, values, 1, &underrun);
+	check(ok && n == 1 && !underrun && model.outputFifo.level == 2, "writeStream reports an underrun once");
+
+	check(FPGA.writeStream(0, values, 1) == -1 && FPGA.writeStream(MODEL_STREAM, values, 1) == -1,
+		"writeStream rejects registers without an output FIFO");
+}
+
+static FPGARegisterFile table(1);
+
+static void testRegisterFileBegin() {
+	bool ok = table.begin();
+	if (!ok) printf("      %s\n", table.getErrorMessage());
+	check(ok && table.getSize() == MODEL_RAM_WORDS && table.getWidth() == MODEL_RAM_WIDTH,
+		"FPGARegisterFile.begin() reads the descriptor of the jtag_register_file");
+}
+
+static void testRegisterFileBlocks() {
+	int64_t values[MODEL_RAM_WORDS], read[MODEL_RAM_WORDS];
+	for (int i = 0; i < MODEL_RAM_WORDS; i++) values[i] = (i * 0x010203) ^ 0xA5A5A5;
+
+	bool ok = table.write(0, values, MODEL_RAM_WORDS);
+	for (int i = 0; i < MODEL_RAM_WORDS; i++) ok = ok && model.ram[i] == (uint32_t)values[i];
+	ok = ok && table.read(0, read, MODEL_RAM_WORDS) && memcmp(read, values, sizeof(values)) == 0;
+	check(ok, "FPGARegisterFile writes and reads a block");
+
+	check(!table.write(MODEL_RAM_WORDS - 1, values, 2) && !table.read(MODEL_RAM_WORDS, read, 1) &&
+		table.read(MODEL_RAM_WORDS - 1, read, 1) && read[0] == values[MODEL_RAM_WORDS - 1],
+		"FPGARegisterFile rejects words out of bounds");
+}
+
+// Transfers that continue where the last one of the same direction stopped skip the instruction
+static void testRegisterFileInstructions() {
+	int before = model.ramInstructions;
+	bool ok = true;
+	for (int i = 10; i < 20; i++) ok = ok && table.read(i) == (int64_t)model.ram[i];
+	check(ok && model.ramInstructions == before + 1, "FPGARegisterFile reads consecutive words with one instruction");
+
+	before = model.ramInstructions;
+	ok = table.write(20, 0x111111) && table.write(21, 0x222222);
+	ok = ok && table.read(22) == (int64_t)model.ram[22];
+	ok = ok && table.read(40) == (int64_t)model.ram[40];
+	check(ok && model.ram[20] == 0x111111 && model.ram[21] == 0x222222 && model.ramInstructions == before + 3,
+		"FPGARegisterFile scans a new instruction for another direction or address");
+
+	// A register access in between selects the jtag_interface in the hub
+	before = model.ramInstructions;
+	FPGA.read(0);
+	ok = table.read(41) == (int64_t)model.ram[41];
+	check(ok && model.ramInstructions == before + 1, "FPGARegisterFile scans the instruction again after FPGA.read()");
+}
+
+int main() {
+	testBegin();
+	testReadStream();
+	testWriteStream();
+	testRegisterFileBegin();
+	testRegisterFileBlocks();
+	testRegisterFileInstructions();
+
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
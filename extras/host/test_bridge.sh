@@ -0,0 +1,15 @@
+#!/bin/sh
+#
+# Builds src/jtag.c against the host model of the JTAG bridge and runs the replay test.
+# Needs a host g++, no Arduino toolchain.
+#
+
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT="$HERE/../.."
+OUT=${TMPDIR:-/tmp}/bridge_test
+
+# jtag.c is compiled as C++ so that the PORT registers of Arduino.h can drive the model
+g++ -std=gnu++11 -fpermissive -w -I"$HERE" -I"$ROOT/src" \
+	-x c++ "$ROOT/src/jtag.c" -x none "$HERE/bridge_model.cpp" "$HERE/bridge_test.cpp" -o "$OUT"
+"$OUT"
@@ -0,0 +1,17 @@
+#!/bin/sh
+#
+# Builds src/FPGA.cpp and src/FPGARegisterFile.cpp against the host model of the jtag_interface and the
+# jtag_register_file and runs the register test.
+# Needs a host g++, no Arduino toolchain.
+#
+
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT="$HERE/../.."
+OUT=${TMPDIR:-/tmp}/register_test
+
+# jtag.c is compiled as C++ so that the PORT registers of Arduino.h can drive the model
+g++ -std=gnu++11 -fpermissive -w -DARDUINO_SAMD_MKRVIDOR4000 -I"$HERE" -I"$ROOT/src" \
+	-x c++ "$ROOT/src/jtag.c" -x none "$ROOT/src/FPGA.cpp" "$ROOT/src/FPGARegisterFile.cpp" \
+	"$HERE/bridge_model.cpp" "$HERE/register_test.cpp" -o "$OUT"
+"$OUT"
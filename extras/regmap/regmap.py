@@ -0,0 +1,314 @@
+#!/usr/bin/env python3
+#
+# Register map generator for the JTAG_Interface.
+#
+# Takes one register map description (JSON) and generates both sides of it:
+#   - a Verilog wrapper around jtag_interface with one port per signal, like jtag_interface7.v
+#   - a C++ header with the matching FPGAInterface<> and typed accessors for the Arduino sketch
+#
+# Signals narrower than a register are packed densely into shared registers, signals marked
+# as "hot" are placed at the lowest indices, so all of them can be transferred with a single
+# FPGA.readBurst()/writeBurst(). Input (FPGA -> CPU) and output (CPU -> FPGA) registers are
+# numbered independently, because every index of jtag_memory has both an input and an output.
+#
+# Usage: python3 regmap.py example.json --verilog MyRegisters.v --header MyRegisters.h
+#
+# Map description:
+#   {
+#     "name": "MyRegisters",                 Module and namespace name
+#     "width": 32,                           Register width, 8 to 64
+#     "signals": [
+#       { "name": "ticks", "direction": "in", "width": 32, "hot": true },
+#       { "name": "speed", "direction": "out", "type": "float" },
+#       { "name": "enable", "direction": "out", "width": 1 },
+#       ...
+#     ]
+#   }
+# "type" is optional and one of the C++ types below, it sets the width of the signal. Signals
+# with a type always get a register of their own and are accessed with Register<>/InputRegister<>,
+# packed signals are RegisterField<> of a FieldRegister<> (outputs) or an input register.
+#
+
+import argparse
+import json
+import re
+import sys
+import zlib
+
+TYPES = {
+    "bool": 1,
+    "uint8_t": 8, "int8_t": 8,
+    "uint16_t": 16, "int16_t": 16,
+    "uint32_t": 32, "int32_t": 32, "float": 32,
+    "uint64_t": 64, "int64_t": 64, "double": 64,
+}
+
+
+class MapError(Exception):
+    pass
+
+
+class Signal:
+    def __init__(self, desc, registerWidth):
+        self.name = desc.get("name", "")
+        if not re.match(r"^[A-Za-z_][A-Za-z0-9_]*$", self.name):
+            raise MapError("Invalid signal name '%s'" % self.name)
+
+        self.direction = desc.get("direction")
+        if self.direction not in ("in", "out"):
+            raise MapError("Signal '%s': direction must be 'in' or 'out'" % self.name)
+
+        self.type = desc.get("type")
+        if self.type is not None:
+            if self.type not in TYPES:
+                raise MapError("Signal '%s': unknown type '%s'" % (self.name, self.type))
+            self.width = TYPES[self.type]
+        else:
+            self.width = int(desc.get("width", registerWidth))
+
+        if self.width < 1 or self.width > registerWidth:
+            raise MapError("Signal '%s' does not fit into a %d-bit register" % (self.name, registerWidth))
+
+        self.hot = bool(desc.get("hot", False))
+        self.index = None
+        self.offset = 0
+
+    def ownsRegister(self, registerWidth):
+        return self.type is not None or self.width == registerWidth
+
+
+class Register:
+    def __init__(self, hot):
+        self.hot = hot
+        self.signals = []
+        self.used = 0
+
+
+def assignRegisters(signals, registerWidth):
+    """Places the signals of one direction, hot registers first"""
+    registers = []
+
+    for hot in (True, False):
+        group = [s for s in signals if s.hot == hot]
+        shared = []
+
+        for s in group:
+            if s.ownsRegister(registerWidth):
+                reg = Register(hot)
+                reg.signals.append(s)
+                reg.used = s.width
+                registers.append(reg)
+            else:
+                shared.append(s)
+
+        # First fit decreasing, keeps the number of shared registers low
+        packed = []
+        for s in sorted(shared, key=lambda s: -s.width):
+            for reg in packed:
+                if reg.used + s.width <= registerWidth:
+                    break
+            else:
+                reg = Register(hot)
+                packed.append(reg)
+            s.offset = reg.used
+            reg.used += s.width
+            reg.signals.append(s)
+        registers += packed
+
+    for index, reg in enumerate(registers):
+        for s in reg.signals:
+            s.index = index
+
+    return registers
+
+
+def mapHash(desc):
+    canonical = json.dumps(desc, sort_keys=True, separators=(",", ":"))
+    return zlib.crc32(canonical.encode("utf-8")) & 0xFFFFFFFF
+
+
+def cppType(bits):
+    for t in (8, 16, 32, 64):
+        if bits <= t:
+            return "uint%d_t" % t
+
+
+def generateVerilog(name, width, count, inputs, outputs, hashValue):
+    lines = []
+    lines.append("// Generated by extras/regmap/regmap.py, do not edit. Map hash 0x%08X" % hashValue)
+    lines.append("")
+    lines.append("module %s (" % name)
+    lines.append("\tinput iMAIN_CLK,")
+
+    ports = []
+    for reg in inputs:
+        for s in reg.signals:
+            ports.append("\tinput [%d:0] i%s" % (s.width - 1, s.name))
+    for reg in outputs:
+        for s in reg.signals:
+            ports.append("\toutput [%d:0] o%s" % (s.width - 1, s.name))
+    lines.append(",\n".join(ports))
+    lines.append(");")
+    lines.append("localparam REGISTER_SIZE = %d;" % width)
+    lines.append("localparam NUMBER_OF_REGISTERS = %d;" % count)
+    lines.append("")
+    lines.append("wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] iDATA;")
+    lines.append("wire [NUMBER_OF_REGISTERS-1:0][REGISTER_SIZE-1:0] oDATA;")
+    lines.append("")
+    lines.append("jtag_interface #(")
+    lines.append("")
+    directions = 0
+    for index in range(count):
+        directions |= ((1 if index < len(inputs) else 0) | (2 if index < len(outputs) else 0)) << (index * 2)
+
+    lines.append("\t.REGISTER_SIZE(REGISTER_SIZE),")
+    lines.append("\t.NUMBER_OF_REGISTERS(NUMBER_OF_REGISTERS),")
+    lines.append("\t.REGISTER_DIRECTIONS(%d'h%X)," % (count * 2, directions))
+    lines.append("\t.BUILD_HASH(32'h%08X)" % hashValue)
+    lines.append("\t")
+    lines.append(") jtag_inst (")
+    lines.append("")
+    lines.append("\t.iMAIN_CLK(iMAIN_CLK),")
+    lines.append("\t.iDATA(iDATA),")
+    lines.append("\t.oDATA(oDATA)")
+    lines.append("")
+    lines.append(");")
+    lines.append("")
+
+    for index in range(count):
+        if index >= len(inputs):
+            lines.append("assign iDATA[%d] = 'b0;" % index)
+            continue
+        reg = inputs[index]
+        parts = []
+        if reg.used < width:
+            parts.append("%d'b0" % (width - reg.used))
+        for s in reversed(reg.signals):
+            parts.append("i%s" % s.name)
+        lines.append("assign iDATA[%d] = { %s };" % (index, ", ".join(parts)))
+    lines.append("")
+
+    for reg in outputs:
+        for s in reg.signals:
+            lines.append("assign o%s = oDATA[%d][%d:%d];" % (s.name, s.index, s.offset + s.width - 1, s.offset))
+    lines.append("")
+    lines.append("endmodule")
+    return "\n".join(lines) + "\n"
+
+
+def generateHeader(name, width, count, inputs, outputs, hashValue):
+    guard = re.sub(r"[^A-Z0-9]", "_", name.upper()) + "_H"
+    lines = []
+    lines.append("//")
+    lines.append("// Generated by extras/regmap/regmap.py, do not edit. Map hash 0x%08X" % hashValue)
+    lines.append("// Matches the Verilog module %s, call %s::begin() in setup()." % (name, name))
+    lines.append("// The shadow values of the field registers are per file, include it in one file only.")
+    lines.append("//")
+    lines.append("")
+    lines.append("#ifndef %s" % guard)
+    lines.append("#define %s" % guard)
+    lines.append("")
+    lines.append('#include "FPGAInterface.h"')
+    lines.append("")
+    lines.append("namespace %s {" % name)
+    lines.append("")
+    lines.append("typedef FPGAInterface<%d, %d> Interface;" % (width, count))
+    lines.append("")
+    lines.append("static Interface fpga;")
+    lines.append("static constexpr uint32_t mapHash = 0x%08X;     // FPGA.getModuleInfo().buildHash" % hashValue)
+    lines.append("")
+    lines.append("// Uploads the bitstream and checks that it was built from the same map")
+    lines.append("inline bool begin() {")
+    lines.append("\treturn fpga.begin(mapHash);")
+    lines.append("}")
+    lines.append("")
+
+    for direction, registers in (("Input", inputs), ("Output", outputs)):
+        hot = sum(1 for reg in registers if reg.hot)
+        if hot > 1:
+            lines.append("// %s registers 0 to %d can be transferred in one burst" % (direction, hot - 1))
+        elif hot == 1:
+            lines.append("// %s register 0 is the only hot one" % direction)
+        else:
+            lines.append("// No hot %s registers" % direction.lower())
+        lines.append("static constexpr uint8_t hot%ss = %d;" % (direction, hot))
+        lines.append("")
+
+        for index, reg in enumerate(registers):
+            if len(reg.signals) == 1 and reg.signals[0].ownsRegister(width):
+                s = reg.signals[0]
+                t = s.type if s.type is not None else cppType(s.width)
+                handle = "InputRegister" if direction == "Input" else "Register"
+                # Files that include the header but don't use every handle would warn about the others
+                lines.append("static Interface::%s<%s, %d> %s __attribute__((unused));" % (handle, t, index, s.name))
+                lines.append("")
+                continue
+
+            regName = "%s%d" % (direction.lower(), index)
+            lines.append("// %s register %d" % (direction, index))
+            lines.append("struct %s {" % regName)
+            lines.append("\tstatic constexpr uint8_t index = %d;" % index)
+            for s in reg.signals:
+                lines.append("\ttypedef RegisterField<%d, %d> %s;" % (s.offset, s.width, s.name))
+            lines.append("};")
+            if direction == "Input":
+                lines.append("// Read with fpga.read<%s::index>(), split with Interface::getField<%s::...>()" % (regName, regName))
+            else:
+                lines.append("static Interface::FieldRegister<%d> %sFields __attribute__((unused));" % (index, regName))
+            lines.append("")
+
+    lines.append("} // namespace %s" % name)
+    lines.append("")
+    lines.append("#endif // %s" % guard)
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generates a jtag_interface wrapper and the matching C++ header")
+    parser.add_argument("map", help="register map description (JSON)")
+    parser.add_argument("--verilog", help="Verilog wrapper to write")
+    parser.add_argument("--header", help="C++ header to write")
+    args = parser.parse_args()
+
+    with open(args.map) as f:
+        desc = json.load(f)
+
+    try:
+        name = desc.get("name", "")
+        if not re.match(r"^[A-Za-z_][A-Za-z0-9_]*$", name):
+            raise MapError("Invalid map name '%s'" % name)
+
+        width = int(desc.get("width", 32))
+        if width < 8 or width > 64:
+            raise MapError("Register width is out of bounds. Values between 8 and 64 are allowed.")
+
+        signals = [Signal(s, width) for s in desc.get("signals", [])]
+        names = [s.name for s in signals]
+        for n in names:
+            if names.count(n) > 1:
+                raise MapError("Signal '%s' is defined more than once" % n)
+
+        inputs = assignRegisters([s for s in signals if s.direction == "in"], width)
+        outputs = assignRegisters([s for s in signals if s.direction == "out"], width)
+
+        count = max(len(inputs), len(outputs), 2)
+        if count > 254:
+            raise MapError("The map needs %d registers, at most 254 are allowed." % count)
+    except MapError as e:
+        sys.exit("regmap: %s" % e)
+
+    hashValue = mapHash(desc)
+
+    if args.verilog:
+        with open(args.verilog, "w") as f:
+            f.write(generateVerilog(name, width, count, inputs, outputs, hashValue))
+    if args.header:
+        with open(args.header, "w") as f:
+            f.write(generateHeader(name, width, count, inputs, outputs, hashValue))
+
+    print("%s: %d registers of %d bits, %d inputs and %d outputs used, map hash 0x%08X"
+          % (name, count, width, len(inputs), len(outputs), hashValue))
+
+
+if __name__ == "__main__":
+    main()
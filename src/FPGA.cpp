@@ -24,7 +24,9 @@
 
 #include "FPGA.h"
 #include "upload.h"
+#include "jtag.h"
 #include <SPI.h>
+#include <stdlib.h>
 
 #define TMS     28 // PA14             | SERCOM2/ PAD[2]
 #define TCK     27 // PA13 -> SPI CLK  | SERCOM2/ PAD[1]
@@ -52,50 +54,100 @@
 #define TDO_READ() ((digitalPinToPort(TDO)->IN.reg & digitalPinToBitMask(TDO)) != 0)
 
 #define SPI_JTAG SPI1
-SPISettings JTAG_SPISettings(12000000, LSBFIRST, SPI_MODE0);
+#define SPI_JTAG_SERCOM SERCOM2
+SPISettings JTAG_SPISettings(FPGA_JTAG_CLOCK, LSBFIRST, SPI_MODE0);
+
+#define FEATURE_BURST 0x01	// Feature flags in the identifier of jtag_memory
+#define FEATURE_WIDTHS 0x02
+#define FEATURE_ATOMIC 0x04
+#define FEATURE_STREAMS 0x08
+#define FEATURE_OUTPUT_STREAMS 0x10
+#define FEATURE_CHANGES 0x20
+#define FEATURE_INTERRUPT 0x40
+#define FEATURE_SNAPSHOT 0x100		// From the second feature word of version 4
+#define FEATURE_TIMESTAMPS 0x200
+#define FEATURE_REGISTER_FILE 0x400	// jtag_register_file.v, see FPGARegisterFile.h
+#define FEATURE_BANKS 0x800
+
+#define FPGA_INT_PIN (33u)	// FPGA to SAMD21 signal, oSAM_INT in MKRVIDOR4000_top.v
+
+#define OPERATION_SET 1		// Operations applied by jtag_memory at UPDATE-DR
+#define OPERATION_CLEAR 2
+#define OPERATION_TOGGLE 3
+#define OPERATION_ADD 4
+#define OPERATION_SNAPSHOT 5	// Reads from the shadow bank, with both indices -1: takes the snapshot
+#define OPERATION_CHANGES 6	// With both indices -1: shifts out the change flags
+#define OPERATION_STATUS 7	// Captures the status of a FIFO register instead of an entry, stream write
+
+#define DMA_CHANNEL_TX 0
+#define DMA_CHANNEL_RX 1
+#define DMA_MAX_BEATS 0xFFFF
+#define DMA_MIN_BYTES 16	// Below this, polled SPI is faster than setting up the channels
+
+__attribute__((aligned(16))) static DmacDescriptor dmaDescriptors[2];
+__attribute__((aligned(16))) static DmacDescriptor dmaWriteback[2];
 
 _FPGA FPGA;
 
+bool _FPGA::bitstreamLoaded = false;
+uint32_t _FPGA::lastInstruction = 0;
+bool _FPGA::instructionValid = false;
+volatile uint8_t _FPGA::lockDepth = 0;
+volatile bool _FPGA::interruptPending = false;
+bool _FPGA::interruptAttached = false;
+FPGAUrgentFunction volatile _FPGA::urgentFunctions[FPGA_MAX_URGENT];
+volatile uint8_t _FPGA::numUrgent = 0;
+bool _FPGA::preempting = false;
+
 extern void enableFpgaClock(void);
 
-_FPGA::_FPGA() {
+_FPGA::_FPGA(uint8_t instance) {
 	memset(errorMessage, 0, sizeof(errorMessage));
+	this->instance = instance;
+}
+
+bool _FPGA::begin() {
+	return begin(0, 0);
 }
 
 bool _FPGA::begin(int registerWidth, int numOfRegisters) {
 
-	this->registerWidth = registerWidth;
-	this->numOfRegisters = numOfRegisters;
-	totalRegisters = numOfRegisters + 1;
-	addressWidth = ceil(log2(totalRegisters));
-	for (int i = 0; i < addressWidth; i++) {
-		addressBitmask <<= 1;
-		addressBitmask |= 1;
-	}
+	// 0, 0 means the configuration is taken from the descriptor of the JTAG module
+	bool autoConfig = (registerWidth == 0 && numOfRegisters == 0);
 
-	if (registerWidth < 8 || registerWidth > 64) {
+	if (!autoConfig && (registerWidth < 8 || registerWidth > 64)) {
 		strncpy(errorMessage, "Register width is out of bounds. Values between 8 and 64 are allowed.", 
 			sizeof(errorMessage));
 		error = true;
 		return false;
 	}
 
-	if (numOfRegisters < 2 || numOfRegisters > 254) {
+	if (!autoConfig && (numOfRegisters < 2 || numOfRegisters > 254)) {
 		strncpy(errorMessage, "Number of registers is out of bounds. Values between 2 and 254 are allowed.", 
 			sizeof(errorMessage));
 		error = true;
 		return false;
 	}
 
-	// Upload the bitstream to the FPGA
-    enableFpgaClock();
-    __uploadBitstream();
+	// Upload the bitstream to the FPGA, only once for all instances
+	if (!bitstreamLoaded) {
+		enableFpgaClock();
+		__uploadBitstream();
+
+		// Initialize virtual JTAG client
+		setup();
+		bitstreamLoaded = true;
+	}
 
-	// Initialize virtual JTAG client
-    setup();
+	if (!findInterface(numOfRegisters)) {
+		strncpy(errorMessage, "The JTAG module with this instance number was not found in the virtual JTAG hub. "
+			"Make sure the right FPGA bitstream is loaded.", sizeof(errorMessage));
+		error = true;
+		return false;
+	}
     
 	// Check the JTAG configuration
-	struct _ModuleInfo info = FPGA.getIdentifier();
+	struct _ModuleInfo info = getIdentifier();
 
 	if (info.registerSize == 0 && info.numberOfRegisters == 0) {
 		strncpy(errorMessage, "Looks like the JTAG module did not respond properly. "
@@ -104,26 +156,84 @@ bool _FPGA::begin(int registerWidth, int numOfRegisters) {
 		return false;
 	}
 
-	if (info.registerSize != registerWidth) {
+	if (info.registerFileSize != 0) {
+		strncpy(errorMessage, "The JTAG module with this instance number is a jtag_register_file, "
+			"use FPGARegisterFile to access it.", sizeof(errorMessage));
+		error = true;
+		return false;
+	}
+
+	if (autoConfig) {
+		if (info.version < 3) {
+			strncpy(errorMessage, "The JTAG module on the FPGA is too old to describe itself, "
+				"use FPGA.begin(width, count) or update jtag_memory.v.", sizeof(errorMessage));
+			error = true;
+			return false;
+		}
+		registerWidth = info.registerSize;
+		numOfRegisters = info.numberOfRegisters;
+	}
+
+	if (info.registerSize != registerWidth || registerWidth < 8 || registerWidth > 64) {
 		strncpy(errorMessage, "The register size does not match the JTAG module on the FPGA. "
 			"Make sure the right FPGA bitstream is being loaded.", sizeof(errorMessage));
 		error = true;
 		return false;
 	}
 
-	if (info.numberOfRegisters != numOfRegisters) {
+	if (info.numberOfRegisters != numOfRegisters || numOfRegisters < 2 || numOfRegisters > 254) {
 		strncpy(errorMessage, "The number of usable registers does not match the JTAG module on the FPGA. "
 			"Make sure the right FPGA bitstream is being loaded.", sizeof(errorMessage));
 		error = true;
 		return false;
 	}
+
+	this->registerWidth = registerWidth;
+	if (!reserveRegisterTable(numOfRegisters * info.banks)) {
+		strncpy(errorMessage, "Not enough memory for the register table of the JTAG module.", sizeof(errorMessage));
+		error = true;
+		return false;
+	}
+
+	this->numOfRegisters = numOfRegisters;
+	numBanks = info.banks;
+	bank = 0;
+	registerWidths = widthTable;
+	registerFlags = flagTable;
+	totalRegisters = numOfRegisters + 1;
+	addressWidth = ceil(log2(totalRegisters));
+	addressBitmask = (1UL << addressWidth) - 1;
+	features = info.features;
+	moduleInfo = info;
+
+	// The operation bits of the atomic operations and FIFO registers widen the instruction
+	if (addressWidth * 2 + 4 > virSize) {
+		features &= ~(FEATURE_ATOMIC | FEATURE_STREAMS | FEATURE_OUTPUT_STREAMS | FEATURE_CHANGES | FEATURE_SNAPSHOT | 
+			FEATURE_TIMESTAMPS);
+	}
+
+	if (addressWidth * 2 + 1 > virSize || !readRegisterTable(info)) {
+		strncpy(errorMessage, "The register table of the JTAG module is invalid. "
+			"Make sure the right FPGA bitstream is being loaded.", sizeof(errorMessage));
+		error = true;
+		return false;
+	}
+
+	// The bank register keeps its value over a begin() without a new upload
+	if (numBanks > 1) {
+		bank = 0xFF;
+		selectBank(0);
+	}
 	
 	return true;
 }
 
 void _FPGA::end() {
-    shutdown();
+	if (bitstreamLoaded) shutdown();
+	bitstreamLoaded = false;
+	instructionValid = false;
 	error = false;
+	bridgeAttached = false;
 }
 
 
@@ -136,34 +246,201 @@ void _FPGA::end() {
 
 
 
-#define JTAG_WRITE_INSTRUCTION(data, bits) writeRaw(14, data, bits);
 #define JTAG_READ_DATA(data, bits) readRaw(12, data, bits);
 #define JTAG_WRITE_DATA(data, bits) writeRaw(12, data, bits);
 #define JTAG_TRANSFER_DATA(send, recv, bits) transferRaw(12, send, recv, bits);
 
+#define JTAG_ANY_TO_SIR() incrementStateMachine(10, 0b0011011111);	// from any state to: shift IR	(instruction register)
+#define JTAG_SIR_TO_SDR() incrementStateMachine(5, 0b00111);		// from shift IR to shift DR	(data register)
+#define JTAG_RESET() incrementStateMachine(5, 0b11111);				// from any state to reset
+#define JTAG_SDR_TO_SDR() incrementStateMachine(5, 0b00111);		// from shift DR through update DR to the next shift DR
+
 uint32_t _FPGA::makeAddress(uint8_t writeAddr, uint8_t readAddr) {
 	uint32_t address = 1 << (addressWidth * 2);
 	address |= (writeAddr & addressBitmask) << addressWidth;
 	address |= (readAddr & addressBitmask);
 	return address;
 }
-    
+
+bool _FPGA::findInterface(int numOfRegisters) {
+	jtagHub hub;
+
+	TCK_LOW();		// jtag.c clocks on the rising edge of TCK_HIGH
+	int slaves = jtagEnumerate(&hub);
+	instructionValid = false;
+
+	// The instance number is set by the INSTANCE parameter of jtag_interface, or counted up by Quartus
+	for (int i = 0; i < slaves && i < JTAG_MAX_NODES; i++) {
+		if (JTAG_NODE_TYPE(hub.nodes[i]) == JTAG_ID_VIRTUAL && JTAG_NODE_VENDOR(hub.nodes[i]) == JTAG_VENDOR_ID &&
+			JTAG_NODE_INSTANCE(hub.nodes[i]) == instance) {
+			// The virtual IR of the hub is as wide as the widest one of all slaves,
+			// the slave is selected with its number + 1 in the bits above
+			virSize = hub.virSize;
+			instructionLength = hub.virSize + hub.slaveBits;
+			slaveSelect = (uint32_t)(i + 1) << hub.virSize;
+			return true;
+		}
+	}
+
+	if (numOfRegisters == 0 || instance != 0) return false;
+
+	// The hub could not be read, assume the JTAG module is the only slave
+	virSize = (int)ceil(log2(numOfRegisters + 1)) * 2 + 1;
+	instructionLength = virSize + 1;
+	slaveSelect = 1UL << virSize;
+	return true;
+}
 
 struct _ModuleInfo _FPGA::getIdentifier() {
 	_ModuleInfo info;
+    uint8_t header[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+	// All address bits set selects the descriptor, so the address width does not need to be known yet
+	scanInstruction(((1UL << virSize) - 1) | slaveSelect, instructionLength);
+
+    JTAG_ANY_TO_SIR();
+    pulseTDIO_instruction(10, 12);
+    JTAG_SIR_TO_SDR();
+    pulseTDO(header, sizeof(header));
+
+	info.numberOfRegisters = header[0];
+	info.registerSize = header[1];
+	info.version = header[2];		// Modules older than version 1 only have the lower 16 bits
+	info.features = header[3];
+
+	// Version 3 continues with the build hash and one entry per register in the same scan
+	if (info.version >= 3) {
+		info.buildHash = (uint32_t)header[4] | ((uint32_t)header[5] << 8) | ((uint32_t)header[6] << 16) | 
+			((uint32_t)header[7] << 24);
+
+		// Version 4 has a second feature word before the entries
+		if (info.version >= 4) {
+			uint8_t extended[4];
+			pulseTDO(extended, sizeof(extended));
+			info.features |= ((int)extended[0] << 8) | ((int)extended[1] << 16);
+			info.timestampWidth = (info.features & FEATURE_TIMESTAMPS) ? min((int)extended[2], 32) : 0;
+			info.banks = (info.features & FEATURE_BANKS) ? max((int)extended[3], 1) : 1;
+		}
 
-    uint8_t id[2] = { 0, 0 };
-	transferBytes(nullptr, -1, &id, -1, IDRegSize);
+		// A register file has no entries, the number of its words follows instead
+		if (info.features & FEATURE_REGISTER_FILE) {
+			uint8_t size[4];
+			pulseTDO(size, sizeof(size));
+			uint32_t words = (uint32_t)size[0] | ((uint32_t)size[1] << 8) | ((uint32_t)size[2] << 16) | 
+				((uint32_t)size[3] << 24);
+			info.registerFileSize = (words > 0xFFFF) ? 0xFFFF : words;
+		}
+
+		// One entry per register of all banks, begin() fails if they don't fit into memory
+		int entries = info.numberOfRegisters * info.banks;
+		if (!reserveRegisterTable(entries)) entries = 0;
+		for (int i = 0; i < entries; i++) {
+			uint8_t entry[2];
+			pulseTDO(entry, sizeof(entry));
+			widthTable[i] = entry[0];
+			flagTable[i] = entry[1] & (FPGA_REGISTER_INPUT | FPGA_REGISTER_OUTPUT | FPGA_REGISTER_STREAM | 
+				FPGA_REGISTER_OUTPUT_STREAM | FPGA_REGISTER_PROBE);
+		}
+	}
 
-	info.numberOfRegisters = id[0];
-	info.registerSize = id[1];
+    JTAG_RESET();
 	return info;
 }
 
+struct _ModuleInfo _FPGA::getModuleInfo() {
+	return moduleInfo;
+}
+
 void _FPGA::incrementStateMachine(uint8_t numticks, uint16_t path) {
     for(int i = 0; i < numticks; i++, path >>= 1) pulseTCK(path & 0x0001);
 }
 
+bool _FPGA::readRegisterTable(const _ModuleInfo& info) {
+
+	// Version 3 descriptors already contain the table
+	if (info.version < 3) {
+		memset(flagTable, FPGA_REGISTER_INPUT | FPGA_REGISTER_OUTPUT, numOfRegisters);
+
+		if (info.features & FEATURE_WIDTHS) {
+			// Version 2: One width byte per register after the 32 identifier bits
+			uint8_t descriptor[4 + 254];
+			writeInstruction(makeAddress(-1, -1));
+			readRaw(12, descriptor, IDRegSize + numOfRegisters * 8);
+			memcpy(widthTable, &descriptor[4], numOfRegisters);
+		}
+		else {
+			memset(widthTable, registerWidth, numOfRegisters);
+		}
+	}
+
+	uniformWidths = true;
+	for (int i = 0; i < numOfRegisters * numBanks; i++) {
+		if (widthTable[i] == 0 || widthTable[i] > registerWidth) return false;
+		if (widthTable[i] != registerWidth) uniformWidths = false;
+	}
+	return true;
+}
+
+bool _FPGA::reserveRegisterTable(int entries) {
+
+	// Only grows, the selected bank keeps pointing to the same entries
+	if (entries <= tableEntries) return true;
+	int selected = registerWidths - widthTable;
+
+	uint8_t* widths = (uint8_t*)realloc(widthTable, entries);
+	if (widths == nullptr) return false;
+	widthTable = widths;
+	registerWidths = widthTable + selected;
+
+	uint8_t* flags = (uint8_t*)realloc(flagTable, entries);
+	if (flags == nullptr) return false;
+	flagTable = flags;
+	registerFlags = flagTable + selected;
+
+	tableEntries = entries;
+	return true;
+}
+
+uint8_t _FPGA::transferWidth(uint8_t txIndex, uint8_t rxIndex) {
+	uint8_t txWidth = (txIndex < numOfRegisters) ? registerWidths[txIndex] : 0;
+	uint8_t rxWidth = (rxIndex < numOfRegisters) ? registerWidths[rxIndex] : 0;
+	return max(txWidth, rxWidth);
+}
+
+bool _FPGA::selectBank(uint8_t bank) {
+	if (error || bank >= numBanks) return false;
+	if (bank == this->bank) return true;
+	Lock lock;
+
+	// Operation 001 with both indices -1 shifts the bank number in, the FPGA takes it at UPDATE-DR
+	uint8_t previous = 0;
+	writeInstruction(makeAddress(-1, -1) | ((uint32_t)OPERATION_SET << (addressWidth * 2 + 1)));
+	transferRaw(12, &bank, &previous, 8);
+
+	this->bank = bank;
+	registerWidths = &widthTable[bank * numOfRegisters];
+	registerFlags = &flagTable[bank * numOfRegisters];
+	return true;
+}
+
+uint8_t _FPGA::getBank() {
+	return bank;
+}
+
+int _FPGA::getBankCount() {
+	return numBanks;
+}
+
+int _FPGA::getRegisterWidth(uint8_t index) {
+	if (index >= numOfRegisters) return 0;
+	return registerWidths[index];
+}
+
+uint8_t _FPGA::getRegisterDirection(uint8_t index) {
+	if (index >= numOfRegisters) return 0;
+	return registerFlags[index];
+}
+
 int64_t _FPGA::read(uint8_t index) {
 	if (error) return 0;
 
@@ -172,7 +449,7 @@ int64_t _FPGA::read(uint8_t index) {
     }
 
     int64_t recv = 0;
-	transferBytes(nullptr, -1, &recv, index, registerWidth);
+	transferBytes(nullptr, -1, &recv, index, registerWidths[index]);
     return recv;
 }
 
@@ -183,7 +460,31 @@ void _FPGA::write(uint8_t index, int64_t value) {
         return;
     }
 
-	transferBytes(&value, index, nullptr, -1, registerWidth);
+	transferBytes(&value, index, nullptr, -1, registerWidths[index]);
+}
+
+bool _FPGA::readBurst(uint8_t index, int64_t* values, uint8_t count) {
+	return transferBurst(nullptr, -1, values, index, count);
+}
+
+bool _FPGA::writeBurst(uint8_t index, const int64_t* values, uint8_t count) {
+	return transferBurst(values, index, nullptr, -1, count);
+}
+
+bool _FPGA::setBits(uint8_t index, int64_t mask) {
+	return modify(index, OPERATION_SET, mask);
+}
+
+bool _FPGA::clearBits(uint8_t index, int64_t mask) {
+	return modify(index, OPERATION_CLEAR, mask);
+}
+
+bool _FPGA::toggleBits(uint8_t index, int64_t mask) {
+	return modify(index, OPERATION_TOGGLE, mask);
+}
+
+bool _FPGA::add(uint8_t index, int64_t value) {
+	return modify(index, OPERATION_ADD, value);
 }
 
 int64_t _FPGA::transfer(uint8_t readIndex, uint8_t writeIndex, int64_t value) {
@@ -194,22 +495,177 @@ int64_t _FPGA::transfer(uint8_t readIndex, uint8_t writeIndex, int64_t value) {
     }
 
     int64_t recv = 0;
-	transferBytes(&value, writeIndex, &recv, readIndex, registerWidth);
+	transferBytes(&value, writeIndex, &recv, readIndex, transferWidth(writeIndex, readIndex));
     return recv;
 }
 
 void _FPGA::transferBytes(const void* txBuffer, uint8_t txIndex, void* rxBuffer, uint8_t rxIndex, uint8_t bits) {
 	if (error) return;
+	Lock lock;
 
 	int64_t writeDummy = 0, readDummy = 0;
 	const void* _txBuffer = (txBuffer != nullptr) ? txBuffer : &writeDummy;
 	void* _rxBuffer = (rxBuffer != nullptr) ? rxBuffer : &readDummy;
 
 	uint32_t address = makeAddress(txIndex, rxIndex);
-    JTAG_WRITE_INSTRUCTION(&address, addressWidth * 2 + 1);
+    writeInstruction(address);
     JTAG_TRANSFER_DATA(_txBuffer, _rxBuffer, bits);
 }
 
+int _FPGA::writeBufferV(const jtagSegment* segments, size_t count) {
+	if (error) return -1;
+	Lock lock;
+	if (!attachBridge()) return -1;
+
+	TCK_LOW();		// jtag.c clocks on the rising edge of TCK_HIGH
+	instructionValid = false;
+	return jtagWriteBufferV(segments, count);
+}
+
+int _FPGA::readBufferV(const jtagSegment* segments, size_t count) {
+	if (error) return -1;
+	Lock lock;
+	if (!attachBridge()) return -1;
+
+	TCK_LOW();		// jtag.c clocks on the rising edge of TCK_HIGH
+	instructionValid = false;
+	return jtagReadBufferV(segments, count);
+}
+
+bool _FPGA::copyToFPGA(uint32_t address, const void* src, size_t words) {
+	if (error) return false;
+	Lock lock;
+	if (!attachBridge()) return false;
+
+	uint32_t start = micros();
+
+	TCK_LOW();
+	instructionValid = false;
+	if (jtagBeginWrite(address) < 0) return false;
+
+	// Ending the scan after any word is the same as a copy of the words so far, so the block is shifted
+	// in chunks and an urgent access can take the bus in between. The next chunk starts a new write
+	const uint8_t* _src = (const uint8_t*)src;
+	for (size_t done = 0; done < words; ) {
+		size_t n = min(words - done, (size_t)FPGA_PREEMPT_WORDS);
+
+		if (done > 0 && preemptionPending()) {
+			jtagEndTransfer();
+			servicePreemption();
+
+			TCK_LOW();
+			instructionValid = false;
+			if (jtagBeginWrite(address + done) < 0) return false;
+		}
+
+		pulseTDIO_DMA(_src + done * 4, nullptr, n * 4);
+		done += n;
+	}
+	jtagEndTransfer();
+
+	uint32_t elapsed = micros() - start;
+	transferRate = (elapsed > 0) ? (float)(words * 4) / elapsed : 0;
+	return true;
+}
+
+bool _FPGA::copyFromFPGA(void* dst, uint32_t address, size_t words) {
+	if (error) return false;
+	Lock lock;
+	if (!attachBridge()) return false;
+
+	uint8_t* _dst = (uint8_t*)dst;
+	uint32_t start = micros();
+
+	// The bridge can only buffer a few words, so the block is read in short bursts
+	for (size_t done = 0; done < words; ) {
+		size_t n = min(words - done, (size_t)JBC_MAX_READ_BURST);
+		if (done > 0 && preemptionPending()) servicePreemption();
+
+		TCK_LOW();
+		instructionValid = false;
+		if (jtagBeginRead(address + done, n) < 0) return false;
+		pulseTDIO_DMA(nullptr, _dst + done * 4, n * 4);
+		jtagEndTransfer();
+
+		done += n;
+	}
+
+	uint32_t elapsed = micros() - start;
+	transferRate = (elapsed > 0) ? (float)(words * 4) / elapsed : 0;
+	return true;
+}
+
+float _FPGA::getTransferRate() {
+	return transferRate;
+}
+
+bool _FPGA::setRegionOfInterest(uint8_t configIndex, uint8_t statusIndex, uint16_t frameWidth, uint16_t frameHeight,
+	uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t step, bool binning) {
+	if (error) return false;
+
+	if (configIndex + 1 >= numOfRegisters) return false;
+	if (registerWidths[configIndex] < 32 || registerWidths[configIndex + 1] < 32) return false;
+
+	// The status register describes the block: line buffer size and bank size
+	uint32_t status = read(statusIndex);
+	uint32_t maxWidth = status >> 21;
+	uint32_t bankWords = 1UL << ((status >> 16) & 0x1F);
+	if (maxWidth == 0) return false;		// No ROI_READER connected
+
+	if (width == 0 || width > maxWidth || height == 0 || height > 1023) return false;
+	if ((width * height) % 4 != 0 || (uint32_t)width * height / 4 > bankWords) return false;
+	if (step == 0 || step > 15) return false;
+	if (binning && step != 1 && step != 2 && step != 4 && step != 8) return false;
+
+	// The block only completes a region when its last line has been captured
+	if ((uint32_t)x + (uint32_t)width * step > frameWidth || (uint32_t)y + (uint32_t)height * step > frameHeight) {
+		return false;
+	}
+
+	write(configIndex, ((uint32_t)y << 16) | x);
+	write(configIndex + 1, (uint32_t)width | ((uint32_t)height << 10) | ((uint32_t)step << 20) | ((uint32_t)binning << 24));
+	return true;
+}
+
+int _FPGA::readRegionOfInterest(uint8_t statusIndex, uint32_t bufferAddress, void* dst, size_t bytes) {
+	if (error) return -1;
+	if (bytes % 4 != 0) return -1;
+
+	// A frame completing during the copy starts to overwrite the bank that is read, so the copy is
+	// only valid if the status is still the same afterwards
+	for (int attempt = 0; attempt < FPGA_ROI_RETRIES; attempt++) {
+		uint32_t status = read(statusIndex);
+		uint32_t frame = (status >> 1) & 0x7FFF;
+		uint32_t bankWords = 1UL << ((status >> 16) & 0x1F);
+		if (frame == 0 || bytes > bankWords * 4) return -1;		// No region captured yet
+
+		// The block captures into one bank while the other one is read
+		uint32_t address = bufferAddress + (status & 1) * bankWords;
+		if (!copyFromFPGA(dst, address, bytes / 4)) return -1;
+
+		if (read(statusIndex) == status) return frame;
+	}
+	return -1;
+}
+
+bool _FPGA::attachBridge() {
+	if (bridgeAttached) return true;
+
+	// The bridge found while uploading belongs to the bootloader image,
+	// so the virtual JTAG hub of the user bitstream must be scanned again
+	TCK_LOW();
+	instructionValid = false;
+	if (jtagInit() != 0) {
+		strncpy(errorMessage, "No JTAG_BRIDGE was found in the FPGA bitstream. "
+			"Add FPGA/ip/JTAG_BRIDGE to your design to use the buffer functions.", sizeof(errorMessage));
+		return false;
+	}
+
+	bridgeAttached = true;
+	dmaAvailable = setupDMA();
+	return true;
+}
+
 const char* _FPGA::getErrorMessage() {
 	return errorMessage;
 }
@@ -222,11 +678,9 @@ const char* _FPGA::getErrorMessage() {
 
 
 
-#define JTAG_ANY_TO_SIR() incrementStateMachine(10, 0b0011011111);	// from any state to: shift IR	(instruction register)
-#define JTAG_SIR_TO_SDR() incrementStateMachine(5, 0b00111);		// from shift IR to shift DR	(data register)
-#define JTAG_RESET() incrementStateMachine(5, 0b11111);				// from any state to reset
 
 void _FPGA::readRaw(uint16_t IR, void* data, uint32_t numbits) {
+	Lock lock;
 	uint8_t* _data = (uint8_t*)data;
 
     JTAG_ANY_TO_SIR();
@@ -240,6 +694,7 @@ void _FPGA::readRaw(uint16_t IR, void* data, uint32_t numbits) {
 }
 
 void _FPGA::writeRaw(uint16_t IR, const void* data, uint32_t numbits) { 
+	Lock lock;
 	uint8_t* _data = (uint8_t*)data;
 
     JTAG_ANY_TO_SIR();
@@ -259,13 +714,51 @@ void _FPGA::writeRaw(uint16_t IR, const void* data, uint32_t numbits) {
 }
 
 void _FPGA::transferRaw(uint16_t IR, const void* send, void* recv, uint32_t numbits) {
-	uint8_t* _send = (uint8_t*)send;
-	uint8_t* _recv = (uint8_t*)recv;
+	Lock lock;
 
     JTAG_ANY_TO_SIR();
     pulseTDIO_instruction(10, (unsigned int)IR);
     JTAG_SIR_TO_SDR();
+    shiftData(send, recv, numbits);
+    JTAG_RESET();
+}
+
+void _FPGA::writeInstruction(uint32_t address, bool cached) {
+	// The hub of the virtual JTAG modules expects the number of the slave after the address,
+	// the last bit is shifted by the clock leaving the SHIFT-DR state
+	if (cached) {
+		selectInstruction(address | slaveSelect, instructionLength);
+	}
+	else {
+		scanInstruction(address | slaveSelect, instructionLength);
+	}
+}
 
+void _FPGA::selectInstruction(uint32_t vir, uint32_t numbits) {
+	// The hub keeps the selected slave and its instruction until the next USER1 scan, so the scan
+	// is only needed when switching between instances or addresses
+	if (instructionValid && vir == lastInstruction) return;
+	scanInstruction(vir, numbits);
+}
+
+void _FPGA::scanInstruction(uint32_t vir, uint32_t numbits) {
+	uint8_t* _vir = (uint8_t*)&vir;
+
+	jtagInvalidateVIR();		// jtag.c must select the JTAG_BRIDGE again
+	lastInstruction = vir;
+	instructionValid = true;
+
+    JTAG_ANY_TO_SIR();
+    pulseTDIO_instruction(10, 14);
+    JTAG_SIR_TO_SDR();
+
+    int NumBytes = (numbits - 1) >> 3;
+    if (NumBytes > 0) pulseTDI(_vir, (size_t)(NumBytes));
+    pulseTDIO_instruction(numbits - NumBytes * 8, (unsigned int)(vir >> (NumBytes * 8)));
+    JTAG_RESET();
+}
+
+void _FPGA::shiftData(const void* send, void* recv, uint32_t numbits) {
     int NumBytes = numbits >> 3;
     int NumBits = numbits & 0b111;
     if (NumBits == 0) {
@@ -273,9 +766,74 @@ void _FPGA::transferRaw(uint16_t IR, const void* send, void* recv, uint32_t numb
         NumBytes = NumBytes - 1;
     }
     
-    if (NumBytes > 0) pulseTDIO_SPI(_send, _recv, (size_t)(NumBytes));
-    _recv[NumBytes] = pulseTDIO(NumBits, (unsigned int)_send[NumBytes]);
+    shiftData(send, recv, NumBytes, NumBits);
+}
+
+void _FPGA::shiftData(const void* send, void* recv, int numBytes, int tailBits) {
+	uint8_t* _send = (uint8_t*)send;
+	uint8_t* _recv = (uint8_t*)recv;
+
+    if (numBytes > 0) pulseTDIO_SPI(_send, _recv, (size_t)(numBytes));
+    _recv[numBytes] = pulseTDIO(tailBits, (unsigned int)_send[numBytes]);
+}
+
+void _FPGA::scanData(const void* send, void* recv, int numBytes, int tailBits) {
+    JTAG_ANY_TO_SIR();
+    pulseTDIO_instruction(10, 12);
+    JTAG_SIR_TO_SDR();
+    shiftData(send, recv, numBytes, tailBits);
+    JTAG_RESET();
+}
+
+bool _FPGA::transferBurst(const int64_t* txValues, uint8_t txIndex, int64_t* rxValues, uint8_t rxIndex, uint8_t count, 
+	uint8_t operation) {
+	if (error) return false;
+	Lock lock;
+
+	if ((txValues != nullptr && txIndex + count > numOfRegisters) ||
+		(rxValues != nullptr && rxIndex + count > numOfRegisters)) {
+		return false;
+	}
+
+	if (!(features & FEATURE_BURST)) {
+		for (uint8_t i = 0; i < count; i++) {
+			uint8_t tx = txValues ? txIndex + i : -1;
+			uint8_t rx = rxValues ? rxIndex + i : -1;
+			transferBytes(txValues ? &txValues[i] : nullptr, tx, rxValues ? &rxValues[i] : nullptr, rx, transferWidth(tx, rx));
+		}
+		return true;
+	}
+
+	if (count == 0) return true;
+
+	// The cleared single access bit makes the FPGA advance both indices at every UPDATE-DR,
+	// so the registers are shifted back to back without a new instruction in between.
+	// The instruction is always shifted, as its UPDATE-IR restarts the burst
+	uint32_t burst = ~(1UL << (addressWidth * 2));
+	uint32_t flags = (uint32_t)operation << (addressWidth * 2 + 1);
+	writeInstruction((makeAddress(txIndex, rxIndex) & burst) | flags, false);
+
+	int64_t writeDummy = 0, readDummy = 0;
+
+    JTAG_ANY_TO_SIR();
+    pulseTDIO_instruction(10, 12);
+    JTAG_SIR_TO_SDR();
+
+	for (uint8_t i = 0; i < count; i++) {
+		if (i > 0 && preemptionPending()) {
+			// A new burst from register i on, unused indices stay -1
+			preemptScan((makeAddress(txValues ? txIndex + i : txIndex, rxValues ? rxIndex + i : rxIndex) & burst) | flags, false);
+		}
+		else if (i > 0) {
+			JTAG_SDR_TO_SDR();
+		}
+		if (rxValues != nullptr) rxValues[i] = 0;
+		uint8_t bits = transferWidth(txValues ? txIndex + i : -1, rxValues ? rxIndex + i : -1);
+		shiftData(txValues ? &txValues[i] : &writeDummy, rxValues ? &rxValues[i] : &readDummy, bits);
+	}
+
     JTAG_RESET();
+	return true;
 }
 
 
@@ -291,6 +849,399 @@ void _FPGA::transferRaw(uint16_t IR, const void* send, void* recv, uint32_t numb
 
 
 
+int _FPGA::getStreamLevel(uint8_t index, bool* overflow) {
+	if (error) return -1;
+	Lock lock;
+
+	if (index >= numOfRegisters) return -1;
+
+	if (!((features & FEATURE_STREAMS) && (registerFlags[index] & FPGA_REGISTER_STREAM)) &&
+		!((features & FEATURE_OUTPUT_STREAMS) && (registerFlags[index] & FPGA_REGISTER_OUTPUT_STREAM))) {
+		return -1;
+	}
+
+	// Status: bit 0 overflow (underrun for output FIFOs), the fill level (free entries) above
+	int64_t status = 0;
+	writeInstruction(makeAddress(-1, index) | ((uint32_t)OPERATION_STATUS << (addressWidth * 2 + 1)));
+	JTAG_READ_DATA(&status, registerWidths[index]);
+
+	if (overflow != nullptr) *overflow = status & 0x01;
+	return (int)((status >> 1) & 0x7FFF);
+}
+
+int _FPGA::readStream(uint8_t index, int64_t* values, int count, bool* overflow) {
+	if (error) return -1;
+	Lock lock;
+
+	if (index < numOfRegisters && !(registerFlags[index] & FPGA_REGISTER_STREAM)) return -1;
+
+	int level = getStreamLevel(index, overflow);
+	if (level < 0) return -1;
+	if (count > level) count = level;
+	if (count <= 0) return 0;
+
+	// In single access mode the index stays the same, every CAPTURE-DR takes the next entry out of the FIFO.
+	// Only as many entries as the status reported are read, so an empty FIFO is never captured
+	writeInstruction(makeAddress(-1, index));
+
+	int64_t writeDummy = 0;
+
+    JTAG_ANY_TO_SIR();
+    pulseTDIO_instruction(10, 12);
+    JTAG_SIR_TO_SDR();
+
+	for (int i = 0; i < count; i++) {
+		if (i > 0 && preemptionPending()) preemptScan(makeAddress(-1, index), true);
+		else if (i > 0) JTAG_SDR_TO_SDR();
+		values[i] = 0;
+		shiftData(&writeDummy, &values[i], registerWidths[index]);
+	}
+
+    JTAG_RESET();
+	return count;
+}
+
+int _FPGA::writeStream(uint8_t index, const int64_t* values, int count, bool* underrun) {
+	if (error) return -1;
+	Lock lock;
+
+	if (index >= numOfRegisters || !(features & FEATURE_OUTPUT_STREAMS) || 
+		!(registerFlags[index] & FPGA_REGISTER_OUTPUT_STREAM)) {
+		return -1;
+	}
+
+	if (underrun != nullptr) *underrun = false;
+	if (count <= 0) return 0;
+
+	// Stream write: the status of the FIFO is shifted out while the value is shifted in, and the FPGA only
+	// takes the value if that status had space. So it is known after every scan whether the value arrived
+	writeInstruction(makeAddress(index, -1) | ((uint32_t)OPERATION_STATUS << (addressWidth * 2 + 1)));
+
+    JTAG_ANY_TO_SIR();
+    pulseTDIO_instruction(10, 12);
+    JTAG_SIR_TO_SDR();
+
+	int accepted = 0;
+	while (accepted < count) {
+		if (accepted > 0 && preemptionPending()) {
+			preemptScan(makeAddress(index, -1) | ((uint32_t)OPERATION_STATUS << (addressWidth * 2 + 1)), true);
+		}
+		else if (accepted > 0) {
+			JTAG_SDR_TO_SDR();
+		}
+
+		int64_t status = 0;
+		shiftData(&values[accepted], &status, registerWidths[index]);
+		if (underrun != nullptr && (status & 0x01)) *underrun = true;
+		if (((status >> 1) & 0x7FFF) == 0) break;		// Full, the value was dropped
+		accepted++;
+	}
+
+    JTAG_RESET();
+	return accepted;
+}
+
+int _FPGA::readChanged(int64_t* values, uint8_t* changed) {
+	return readChangedRegisters(values, changed, nullptr, nullptr);
+}
+
+int _FPGA::readChanged(FPGAChangeCallback callback) {
+	return readChangedRegisters(nullptr, nullptr, callback, nullptr);
+}
+
+int _FPGA::readChangedRegisters(int64_t* values, uint8_t* changed, FPGAChangeCallback callback, const uint8_t* mask) {
+	if (error) return -1;
+	if (!(features & FEATURE_CHANGES)) return -1;
+	Lock lock;
+
+	uint8_t flags[sizeof(interruptMask)];
+	memset(flags, 0, sizeof(flags));
+
+	// One bit per register, register 0 first. The interrupt mask is shifted in at the same time
+	writeInstruction(makeAddress(-1, -1) | ((uint32_t)OPERATION_CHANGES << (addressWidth * 2 + 1)));
+	transferRaw(12, interruptMask, flags, numOfRegisters);
+
+	if (mask != nullptr) {
+		for (int i = 0; i < (numOfRegisters + 7) / 8; i++) flags[i] &= mask[i];
+	}
+	if (changed != nullptr) memcpy(changed, flags, (numOfRegisters + 7) / 8);
+
+	// The change flags are the ones of bank 0
+	uint8_t previousBank = bank;
+	if (!selectBank(0)) return -1;
+
+	int count = 0;
+	int64_t chunk[16];
+
+	for (int i = 0; i < numOfRegisters;) {
+		if (!(flags[i >> 3] & (1 << (i & 7)))) {
+			i++;
+			continue;
+		}
+
+		// Read unchanged registers along as long as that is cheaper than a new instruction
+		int last = i;
+		int gapBits = 0;
+		for (int j = i + 1; j < numOfRegisters && j - i < (int)(sizeof(chunk) / sizeof(chunk[0])); j++) {
+			if (flags[j >> 3] & (1 << (j & 7))) {
+				last = j;
+				gapBits = 0;
+			}
+			else {
+				// Reading a FIFO register along would take an entry out of it
+				gapBits += registerWidths[j] + 5;
+				if (gapBits > instructionLength + 15 || (registerFlags[j] & FPGA_REGISTER_STREAM)) break;
+			}
+		}
+
+		int64_t* target = (values != nullptr) ? &values[i] : chunk;
+		if (!transferBurst(nullptr, -1, target, i, last - i + 1)) {
+			count = -1;
+			break;
+		}
+
+		for (int j = i; j <= last; j++) {
+			if (!(flags[j >> 3] & (1 << (j & 7)))) continue;
+			count++;
+			if (callback != nullptr) callback(j, target[j - i]);
+		}
+		i = last + 1;
+	}
+
+	selectBank(previousBank);
+	return count;
+}
+
+bool _FPGA::attachChangeInterrupt(uint8_t index, FPGAChangeCallback callback) {
+	if (error || this != &FPGA) return false;
+	if (index >= numOfRegisters || callback == nullptr || !(features & FEATURE_INTERRUPT)) return false;
+
+	int slot = -1;
+	for (int i = 0; i < FPGA_MAX_CHANGE_CALLBACKS; i++) {
+		if (callbacks[i] != nullptr && callbackIndex[i] == index) slot = i;
+		else if (callbacks[i] == nullptr && slot < 0) slot = i;
+	}
+	if (slot < 0) return false;
+
+	uint32_t primask = __get_PRIMASK();
+	noInterrupts();
+	callbackIndex[slot] = index;
+	callbacks[slot] = callback;
+	interruptMask[index >> 3] |= 1 << (index & 7);
+	__set_PRIMASK(primask);
+
+	if (!interruptAttached) {
+		pinMode(FPGA_INT_PIN, INPUT);
+		attachInterrupt(digitalPinToInterrupt(FPGA_INT_PIN), interruptHandler, RISING);
+		interruptAttached = true;
+	}
+
+	updateInterruptMask();
+	return true;
+}
+
+void _FPGA::detachChangeInterrupt(uint8_t index) {
+	if (index >= numOfRegisters) return;
+
+	uint32_t primask = __get_PRIMASK();
+	noInterrupts();
+	for (int i = 0; i < FPGA_MAX_CHANGE_CALLBACKS; i++) {
+		if (callbacks[i] != nullptr && callbackIndex[i] == index) callbacks[i] = nullptr;
+	}
+	interruptMask[index >> 3] &= ~(1 << (index & 7));
+	__set_PRIMASK(primask);
+
+	updateInterruptMask();
+}
+
+void _FPGA::updateInterruptMask() {
+	Lock lock;
+	uint8_t flags[sizeof(interruptMask)];
+
+	// The mask takes effect with the change flag scan, the flags themselves are not cleared by it
+	writeInstruction(makeAddress(-1, -1) | ((uint32_t)OPERATION_CHANGES << (addressWidth * 2 + 1)));
+	transferRaw(12, interruptMask, flags, numOfRegisters);
+
+	// A register that differs already would not cause another rising edge
+	if (digitalRead(FPGA_INT_PIN)) interruptPending = true;
+}
+
+void _FPGA::interruptHandler() {
+	// Runs in the EIC interrupt of FPGA_INT: the scans and the callbacks happen here, unless a transaction is
+	// running, then the lock handles it when it ends
+	interruptPending = true;
+	if (lockDepth == 0) servicePreemption();
+}
+
+bool _FPGA::runUrgent(FPGAUrgentFunction function) {
+	if (function == nullptr) return false;
+
+	uint32_t primask = __get_PRIMASK();
+	noInterrupts();
+	bool queued = (numUrgent < FPGA_MAX_URGENT);
+	if (queued) urgentFunctions[numUrgent++] = function;
+	__set_PRIMASK(primask);
+	if (!queued) return false;
+
+	// A transaction is running, it calls the function at its next boundary or when it ends
+	if (lockDepth == 0) servicePreemption();
+	return true;
+}
+
+bool _FPGA::preemptionPending() {
+	return !preempting && (numUrgent > 0 || (interruptPending && interruptAttached));
+}
+
+void _FPGA::servicePreemption() {
+	// Functions queued by interrupts in the meantime see the lock and are taken by the loop
+	Lock lock;
+	preempting = true;
+
+	do {
+		if (interruptPending && interruptAttached) FPGA.serviceInterrupt();
+
+		while (numUrgent > 0) {
+			uint32_t primask = __get_PRIMASK();
+			noInterrupts();
+			FPGAUrgentFunction function = urgentFunctions[0];
+			numUrgent--;
+			for (uint8_t i = 0; i < numUrgent; i++) urgentFunctions[i] = urgentFunctions[i + 1];
+			__set_PRIMASK(primask);
+
+			function();
+		}
+	} while (interruptPending && interruptAttached);
+
+	preempting = false;
+}
+
+void _FPGA::preemptScan(uint32_t address, bool cached) {
+	// The virtual JTAG hub only switches slaves with a new USER1 scan, which has to leave SHIFT-DR through
+	// UPDATE-DR. So the scan ends after the last complete register, and continues with address afterwards
+	JTAG_RESET();
+	servicePreemption();
+
+	writeInstruction(address, cached);
+	JTAG_ANY_TO_SIR();
+	pulseTDIO_instruction(10, 12);
+	JTAG_SIR_TO_SDR();
+}
+
+void _FPGA::serviceInterrupt() {
+	// The pin stays high while any flagged register was not read, a change during the reads gives no new edge
+	for (int i = 0; i < 4 && (interruptPending || digitalRead(FPGA_INT_PIN)); i++) {
+		interruptPending = false;
+		readChangedRegisters(nullptr, nullptr, dispatchChange, interruptMask);
+	}
+}
+
+void _FPGA::dispatchChange(uint8_t index, int64_t value) {
+	for (int i = 0; i < FPGA_MAX_CHANGE_CALLBACKS; i++) {
+		if (FPGA.callbacks[i] != nullptr && FPGA.callbackIndex[i] == index) FPGA.callbacks[i](index, value);
+	}
+}
+
+_FPGA::Lock::Lock() : primask(__get_PRIMASK()) {
+	lockDepth++;
+}
+
+_FPGA::Lock::~Lock() {
+	// An interrupt between the last check and the release would see the lock and leave its work to us,
+	// so the lock is only released with interrupts disabled after a check that found nothing. Afterwards
+	// they are enabled again only if they were when the lock was taken
+	for (;;) {
+		noInterrupts();
+		if (lockDepth != 1 || !preemptionPending()) break;
+		__set_PRIMASK(primask);
+		servicePreemption();		// Still holds the lock, the accesses nest
+	}
+	lockDepth--;
+	__set_PRIMASK(primask);
+}
+
+bool _FPGA::snapshot() {
+	if (error || !(features & FEATURE_SNAPSHOT)) return false;
+	Lock lock;
+
+	// The copy happens at CAPTURE-DR, a single bit is enough to pass through it
+	int64_t dummy = 0;
+	writeInstruction(makeAddress(-1, -1) | ((uint32_t)OPERATION_SNAPSHOT << (addressWidth * 2 + 1)));
+	JTAG_READ_DATA(&dummy, 1);
+	return true;
+}
+
+int64_t _FPGA::readSnapshot(uint8_t index) {
+	if (error || !(features & FEATURE_SNAPSHOT)) return 0;
+	if (index >= numOfRegisters) return 0;
+	Lock lock;
+
+	int64_t recv = 0;
+	writeInstruction(makeAddress(-1, index) | ((uint32_t)OPERATION_SNAPSHOT << (addressWidth * 2 + 1)));
+	JTAG_READ_DATA(&recv, registerWidths[index]);
+	return recv;
+}
+
+bool _FPGA::readSnapshot(uint8_t index, int64_t* values, uint8_t count) {
+	if (!(features & FEATURE_SNAPSHOT)) return false;
+	return transferBurst(nullptr, -1, values, index, count, OPERATION_SNAPSHOT);
+}
+
+int64_t _FPGA::read(uint8_t index, uint32_t* timestamp) {
+	if (error || index >= numOfRegisters) return 0;
+	return readWithTimestamp(makeAddress(-1, index), registerWidths[index], timestamp);
+}
+
+int64_t _FPGA::readSnapshot(uint8_t index, uint32_t* timestamp) {
+	if (error || !(features & FEATURE_SNAPSHOT) || index >= numOfRegisters) return 0;
+	return readWithTimestamp(makeAddress(-1, index) | ((uint32_t)OPERATION_SNAPSHOT << (addressWidth * 2 + 1)), 
+		registerWidths[index], timestamp);
+}
+
+uint32_t _FPGA::readTimestamp() {
+	if (error || !(features & FEATURE_TIMESTAMPS)) return 0;
+
+	// Both indices -1 without the single access bit: no register, only the timestamp is shifted
+	uint32_t timestamp = 0;
+	readWithTimestamp(makeAddress(-1, -1) & ~(1UL << (addressWidth * 2)), 0, &timestamp);
+	return timestamp;
+}
+
+int64_t _FPGA::readWithTimestamp(uint32_t address, uint8_t bits, uint32_t* timestamp) {
+	Lock lock;
+	int timestampBits = (features & FEATURE_TIMESTAMPS) ? moduleInfo.timestampWidth : 0;
+
+	// The timestamp follows right after the register in the same scan
+	uint8_t data[12];
+	memset(data, 0, sizeof(data));
+	writeInstruction(address);
+	if (bits + timestampBits > 0) JTAG_READ_DATA(data, bits + timestampBits);
+
+	uint64_t low = 0, high = 0;
+	for (int i = 7; i >= 0; i--) low = (low << 8) | data[i];
+	for (int i = 11; i >= 8; i--) high = (high << 8) | data[i];
+
+	if (timestamp != nullptr) {
+		uint64_t ticks = (bits == 0) ? low : (bits == 64) ? high : ((low >> bits) | (high << (64 - bits)));
+		*timestamp = (timestampBits == 0) ? 0 : (uint32_t)(ticks & (0xFFFFFFFFUL >> (32 - timestampBits)));
+	}
+	return (bits >= 64) ? (int64_t)low : (int64_t)(low & ((1ULL << bits) - 1));
+}
+
+bool _FPGA::modify(uint8_t index, uint8_t operation, int64_t operand) {
+	if (error) return false;
+	Lock lock;
+
+	if (index >= numOfRegisters || !(features & FEATURE_ATOMIC)) {
+		return false;
+	}
+
+	// The operation sits above the single access bit, nothing is read back
+	uint32_t address = makeAddress(index, -1) | ((uint32_t)operation << (addressWidth * 2 + 1));
+	writeInstruction(address);
+	JTAG_WRITE_DATA(&operand, registerWidths[index]);
+	return true;
+}
+
 void _FPGA::setup() {
 
 	pinMode(TMS, OUTPUT);
@@ -336,8 +1287,9 @@ void _FPGA::pulseTDI(const void* data, size_t size) {
 	TCK_PMUX();
 	TDI_PMUX();
 
+	const uint8_t* _data = (const uint8_t*)data;
 	for (size_t i = 0; i < size; i++) {
-		SPI_JTAG.transfer(*(const uint8_t*)data++);
+		SPI_JTAG.transfer(_data[i]);
 	}
 
 	TCK_UNPMUX();
@@ -411,3 +1363,80 @@ void _FPGA::pulseTDIO_SPI(const void* send, void* recv, size_t size) {
 	TDI_UNPMUX();
 	TDO_UNPMUX();
 }
+
+void _FPGA::pulseTDIO_DMA(const void* send, void* recv, size_t size) {
+	const uint8_t* _send = (const uint8_t*)send;
+	uint8_t* _recv = (uint8_t*)recv;
+	static uint8_t dummySend = 0x00;
+	static uint8_t dummyRecv;
+
+	TCK_LOW();
+	TCK_PMUX();
+	TDI_PMUX();
+	TDO_PMUX();
+
+	while (size > 0) {
+		uint16_t beats = min(size, (size_t)DMA_MAX_BEATS);
+
+		if (dmaAvailable && beats >= DMA_MIN_BYTES) {
+			// The receive channel always runs, otherwise stale bytes would be left in the SPI buffer
+			volatile void* data = &SPI_JTAG_SERCOM->SPI.DATA.reg;
+			startDMA(DMA_CHANNEL_RX, SERCOM2_DMAC_ID_RX, (_recv ? DMAC_BTCTRL_DSTINC : 0),
+				(uint32_t)(uintptr_t)data, (uint32_t)(uintptr_t)(_recv ? _recv + beats : &dummyRecv), beats);
+			startDMA(DMA_CHANNEL_TX, SERCOM2_DMAC_ID_TX, (_send ? DMAC_BTCTRL_SRCINC : 0),
+				(uint32_t)(uintptr_t)(_send ? _send + beats : &dummySend), (uint32_t)(uintptr_t)data, beats);
+
+			DMAC->CHID.reg = DMAC_CHID_ID(DMA_CHANNEL_RX);
+			while (!(DMAC->CHINTFLAG.reg & DMAC_CHINTFLAG_TCMPL));
+		}
+		else {
+			for (uint16_t i = 0; i < beats; i++) {
+				uint8_t in = SPI_JTAG.transfer(_send ? _send[i] : 0x00);
+				if (_recv) _recv[i] = in;
+			}
+		}
+
+		if (_send) _send += beats;
+		if (_recv) _recv += beats;
+		size -= beats;
+	}
+
+	TCK_UNPMUX();
+	TDI_UNPMUX();
+	TDO_UNPMUX();
+}
+
+void _FPGA::startDMA(uint8_t channel, uint8_t trigger, uint16_t btctrl, uint32_t src, uint32_t dst, uint16_t beats) {
+	DmacDescriptor* descriptor = &dmaDescriptors[channel];
+	descriptor->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE | btctrl;
+	descriptor->BTCNT.reg = beats;
+	descriptor->SRCADDR.reg = src;		// When incrementing, the addresses point to the end of the block
+	descriptor->DSTADDR.reg = dst;
+	descriptor->DESCADDR.reg = 0;
+
+	DMAC->CHID.reg = DMAC_CHID_ID(channel);
+	DMAC->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+	DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+	DMAC->CHCTRLB.reg = DMAC_CHCTRLB_LVL(0) | DMAC_CHCTRLB_TRIGSRC(trigger) | DMAC_CHCTRLB_TRIGACT_BEAT;
+	DMAC->CHINTFLAG.reg = DMAC_CHINTFLAG_MASK;
+	DMAC->CHCTRLA.reg = DMAC_CHCTRLA_ENABLE;
+}
+
+bool _FPGA::setupDMA() {
+
+	// If another library already owns the DMA controller, polled SPI is used instead
+	if (DMAC->CTRL.bit.DMAENABLE && DMAC->BASEADDR.reg != (uint32_t)(uintptr_t)dmaDescriptors) {
+		return false;
+	}
+
+	PM->AHBMASK.reg |= PM_AHBMASK_DMAC;
+	PM->APBBMASK.reg |= PM_APBBMASK_DMAC;
+
+	if (!DMAC->CTRL.bit.DMAENABLE) {
+		DMAC->BASEADDR.reg = (uint32_t)(uintptr_t)dmaDescriptors;
+		DMAC->WRBADDR.reg = (uint32_t)(uintptr_t)dmaWriteback;
+		DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xf);
+	}
+
+	return true;
+}
@@ -36,19 +36,56 @@
 #define FPGA_H
 
 #ifndef ARDUINO_SAMD_MKRVIDOR4000
-  	#error “This library is exclusively for the Arduino MKR Vidor 4000.”
+  	#error "This library is exclusively for the Arduino MKR Vidor 4000."
 #endif
 
 #include "Arduino.h"
 
+struct jtagSegment;	// Declared in jtag.h
+
+#define FPGA_REGISTER_INPUT 0x01		// Register directions, see getRegisterDirection()
+#define FPGA_REGISTER_OUTPUT 0x02
+#define FPGA_REGISTER_STREAM 0x04		// Input register backed by a FIFO, see readStream()
+#define FPGA_REGISTER_OUTPUT_STREAM 0x08	// Output register backed by a FIFO, see writeStream()
+#define FPGA_REGISTER_PROBE 0x20		// Input register fed by latency_probe.v, see FPGATiming
+
+typedef void (*FPGAChangeCallback)(uint8_t index, int64_t value);		// See readChanged()
+
+#define FPGA_MAX_CHANGE_CALLBACKS 8		// See attachChangeInterrupt()
+
+typedef void (*FPGAUrgentFunction)();		// See runUrgent()
+
+#define FPGA_MAX_URGENT 4				// See runUrgent()
+
+#ifndef FPGA_PREEMPT_WORDS
+#define FPGA_PREEMPT_WORDS 64			// copyToFPGA() checks for urgent accesses after every chunk of this many words
+#endif
+
+#define FPGA_ROI_RETRIES 3				// See readRegionOfInterest()
+
+#ifndef FPGA_JTAG_CLOCK
+#define FPGA_JTAG_CLOCK 12000000		// TCK while shifting with SPI, up to 24 MHz with TCK_DOMAIN = 1 in jtag_interface
+#endif
+
 struct _ModuleInfo {
 	int registerSize = 0;
 	int numberOfRegisters = 0;
+	int version = 0;
+	int features = 0;
+	uint32_t buildHash = 0;
+	int timestampWidth = 0;		// Bits of the capture timestamps, 0 if the module has none
+	int registerFileSize = 0;	// Words of a jtag_register_file, 0 for jtag_interface
+	int banks = 1;				// numberOfRegisters is per bank, see selectBank()
 };
 
 class _FPGA {
 public:
-	_FPGA();
+	///
+	/// @brief Every jtag_interface in the bitstream can be accessed with its own object. The global FPGA object
+	/// is instance 0, create more with the instance number set by the INSTANCE parameter of jtag_interface:
+	/// _FPGA bulk(1);
+	///
+	_FPGA(uint8_t instance = 0);
 
 	///
 	/// @brief Upload the FPGA_Bitstream.h to the FPGA.
@@ -58,7 +95,15 @@ public:
 	bool begin(int registerWidth, int numOfRegisters);
 
 	///
-	/// @brief Stop the JTAG communication, in case you need the pins for something else.
+	/// @brief Upload the FPGA_Bitstream.h to the FPGA and take the register size, the number of registers
+	/// and the width of every register from the descriptor of the FPGA module (version 3 or newer).
+	/// Burst mode and exact register widths are used whenever the bitstream supports them.
+	/// @return bool - false if the FPGA module did not respond or cannot describe itself.
+	///
+	bool begin();
+
+	///
+	/// @brief Stop the JTAG communication of all instances, in case you need the pins for something else.
 	/// You wouldn't usually use this function. In rare cases, it could be used to clear the
 	/// error and dynamically reload in the future.
 	///
@@ -86,11 +131,252 @@ public:
 	///
 	int64_t transfer(uint8_t readIndex, uint8_t writeIndex, int64_t value);
 
+	///
+	/// @brief Reads count consecutive registers starting at index in one burst. The address is only sent once,
+	/// the FPGA advances it after every register. Bitstreams without burst support are read register by register.
+	/// @return bool - false if the registers are out of range.
+	///
+	bool readBurst(uint8_t index, int64_t* values, uint8_t count);
+
+	///
+	/// @brief Writes count consecutive registers starting at index in one burst. The address is only sent once,
+	/// the FPGA advances it after every register. Bitstreams without burst support are written register by register.
+	/// @return bool - false if the registers are out of range.
+	///
+	bool writeBurst(uint8_t index, const int64_t* values, uint8_t count);
+
+	///
+	/// @brief Sets the bits of mask in an output register. The FPGA applies the change itself, so it takes
+	/// a single write and there is no read-modify-write that an interrupt could disturb.
+	/// @return bool - false if the index is out of range or the bitstream has no atomic operations.
+	///
+	bool setBits(uint8_t index, int64_t mask);
+
+	///
+	/// @brief Clears the bits of mask in an output register, atomically like setBits().
+	///
+	bool clearBits(uint8_t index, int64_t mask);
+
+	///
+	/// @brief Inverts the bits of mask in an output register, atomically like setBits().
+	///
+	bool toggleBits(uint8_t index, int64_t mask);
+
+	///
+	/// @brief Adds value to an output register, atomically like setBits(). The result wraps at the
+	/// register width, add a negative value to subtract.
+	///
+	bool add(uint8_t index, int64_t value);
+
+	///
+	/// @brief Reads up to count entries from a FIFO register (FIFO_REGISTERS of jtag_interface), oldest first.
+	/// Every entry is read exactly once, samples arriving between two calls are kept in the FIFO on the FPGA.
+	/// The fill level is read first and the entries follow in one chain of scans with a single instruction.
+	/// @param overflow - optional, set to true if the FIFO was full and samples were lost since the last call.
+	/// @return int - number of entries read, -1 if the register is not a FIFO register.
+	///
+	int readStream(uint8_t index, int64_t* values, int count, bool* overflow = nullptr);
+
+	///
+	/// @brief Writes up to count values into an output FIFO register (OUTPUT_FIFO_REGISTERS of jtag_interface),
+	/// the FPGA side takes them at its own pace. Every scan also returns the free space of the FIFO, so writing
+	/// stops at the first value the full FIFO did not take. It does not wait: call it again with the remaining
+	/// values, e.g. in the next loop().
+	/// @param underrun - optional, set to true if the FPGA side found the FIFO empty since the last call.
+	/// @return int - number of values taken, -1 if the register is not an output FIFO register.
+	///
+	int writeStream(uint8_t index, const int64_t* values, int count, bool* underrun = nullptr);
+
+	///
+	/// @brief Returns the number of entries waiting in a FIFO register without reading them, or the number of
+	/// free entries of an output FIFO register. -1 if the register is neither. Clears the overflow/underrun flag.
+	///
+	int getStreamLevel(uint8_t index, bool* overflow = nullptr);
+
+	///
+	/// @brief Reads only the input registers that changed since they were read last. One short scan tells which
+	/// ones changed, these are then read in bursts. values needs one entry per register and should keep the last
+	/// read values: registers between two changed ones may be read along, with their unchanged value. FIFO registers
+	/// count as changed while they are not empty, one entry is read.
+	/// @param changed - optional, one bit per register (register 0 in bit 0 of the first byte), set if it changed.
+	/// @return int - number of changed registers, -1 if the bitstream has no change flags.
+	///
+	int readChanged(int64_t* values, uint8_t* changed = nullptr);
+
+	///
+	/// @brief Same as readChanged() above, but calls callback(index, value) for every changed register instead.
+	///
+	int readChanged(FPGAChangeCallback callback);
+
+	///
+	/// @brief Calls callback(index, value) whenever input register index changes (or crosses its threshold, see
+	/// THRESHOLD_REGISTERS in jtag_memory.v), without polling. The FPGA raises FPGA_INT, oINTERRUPT of jtag_interface
+	/// must be connected to oSAM_INT. The register is read in the interrupt handler, or right after the current
+	/// transfer if the interrupt came in during one. The handler of the pin interrupt does the JTAG scans itself:
+	/// the change flags, then every flagged register, which keeps interrupts of the same and lower priority
+	/// waiting for some 10 us per register. The callback runs in the same interrupt context, keep it short and
+	/// don't wait for other interrupts in it. Only the global FPGA object can handle interrupts, there is one pin.
+	/// @return bool - false if the bitstream has no interrupt or all FPGA_MAX_CHANGE_CALLBACKS are in use.
+	///
+	bool attachChangeInterrupt(uint8_t index, FPGAChangeCallback callback);
+
+	///
+	/// @brief Stops the callback of attachChangeInterrupt() for a register.
+	///
+	void detachChangeInterrupt(uint8_t index);
+
+	///
+	/// @brief Runs function as soon as the JTAG bus is free, for register accesses from interrupt handlers that cannot
+	/// wait for a long transfer. If no transfer is running, it runs right away. Otherwise the running transfer stops at
+	/// its next boundary: bursts and streams after the current register, copyToFPGA() after FPGA_PREEMPT_WORDS words
+	/// and copyFromFPGA() after a read burst. function runs there and the transfer continues with a new instruction
+	/// where it stopped. Other calls finish first. function must leave the selected bank as it found it. It runs in
+	/// the context that frees the bus: the caller of runUrgent(), the interrupted transfer or the pin interrupt of
+	/// attachChangeInterrupt().
+	/// @return bool - false if FPGA_MAX_URGENT functions are already waiting.
+	///
+	bool runUrgent(FPGAUrgentFunction function);
+
+	///
+	/// @brief Copies all input registers into the shadow bank of the FPGA in the same clock. readSnapshot() then
+	/// reads them from there, so values read one by one or over several loop iterations still belong together,
+	/// e.g. the positions of several encoders. The shadow bank keeps them until the next snapshot().
+	/// @return bool - false if the bitstream has no shadow bank (SNAPSHOT in jtag_memory.v).
+	///
+	bool snapshot();
+
+	///
+	/// @brief Reads a register as it was at the last snapshot(). Returns 0 if the index is out of bounds.
+	///
+	int64_t readSnapshot(uint8_t index);
+
+	///
+	/// @brief Reads count consecutive registers of the last snapshot() in one burst, like readBurst().
+	/// @return bool - false if the registers are out of range or the bitstream has no shadow bank.
+	///
+	bool readSnapshot(uint8_t index, int64_t* values, uint8_t count);
+
+	///
+	/// @brief Reads a register like read() and also returns in timestamp the FPGA clock tick at which the value
+	/// was captured, in the same scan. For bitstreams without timestamps (TIMESTAMP_WIDTH in jtag_memory.v)
+	/// timestamp is set to 0.
+	///
+	int64_t read(uint8_t index, uint32_t* timestamp);
+
+	///
+	/// @brief Reads a register of the last snapshot() like readSnapshot(), timestamp is the time of the snapshot.
+	///
+	int64_t readSnapshot(uint8_t index, uint32_t* timestamp);
+
+	///
+	/// @brief Returns the current FPGA clock tick, the counter behind the timestamps. 0 without timestamps.
+	/// FPGATiming (FPGATiming.h) relates it to micros() and converts timestamps with ticksToMicros().
+	///
+	uint32_t readTimestamp();
+
+	///
+	/// @brief Selects the bank of registers that all indices refer to, for bitstreams with BANKS set on
+	/// jtag_interface. The instruction only holds the index inside the bank, so it stays short no matter how
+	/// many banks there are. Selecting the bank that is already selected costs nothing, switching costs one
+	/// scan. Keep the registers used all the time in bank 0, which is selected by begin(). readChanged() and
+	/// attachChangeInterrupt() always refer to bank 0. begin() allocates the width and flag table of all banks
+	/// on the heap, 2 bytes per register.
+	/// @return bool - false if the bank does not exist.
+	///
+	bool selectBank(uint8_t bank);
+
+	///
+	/// @brief Returns the selected bank, 0 without banks.
+	///
+	uint8_t getBank();
+
+	///
+	/// @brief Returns the number of banks, 1 without banks. getModuleInfo().numberOfRegisters is per bank.
+	///
+	int getBankCount();
+
+	///
+	/// @brief Returns the number of bits of a register. Registers can be narrower than the register size
+	/// if the bitstream sets REGISTER_WIDTHS (see jtag_memory.v), only these bits are transferred.
+	///
+	int getRegisterWidth(uint8_t index);
+
+	///
+	/// @brief Returns FPGA_REGISTER_INPUT and/or FPGA_REGISTER_OUTPUT, depending on which sides of the
+	/// register are connected in the bitstream. Bitstreams that don't tell report both. FIFO registers
+	/// additionally have FPGA_REGISTER_STREAM or FPGA_REGISTER_OUTPUT_STREAM set, latency probes
+	/// FPGA_REGISTER_PROBE.
+	///
+	uint8_t getRegisterDirection(uint8_t index);
+
+	///
+	/// @brief Returns the descriptor of the FPGA module read by begin(): Register size and count, version,
+	/// feature flags and the build hash, which identifies the bitstream variant.
+	///
+	struct _ModuleInfo getModuleInfo();
+
 	///
 	/// @brief Transfers bytes. This is the underlying function, only use it if you know what you're doing
 	///
 	void transferBytes(const void* txBuffer, uint8_t txIndex, void* rxBuffer, uint8_t rxIndex, uint8_t bits);
 
+	///
+	/// @brief Writes a scatter-gather list of 32-bit word buffers through the JTAG_BRIDGE (Avalon master)
+	/// of your bitstream in one pipelined sequence. Include "jtag.h" for the jtagSegment type.
+	/// @return int - the number of words written, or a negative value on error.
+	///
+	int writeBufferV(const jtagSegment* segments, size_t count);
+
+	///
+	/// @brief Reads a scatter-gather list of 32-bit word buffers through the JTAG_BRIDGE (Avalon master)
+	/// of your bitstream in one pipelined sequence. Include "jtag.h" for the jtagSegment type.
+	/// @return int - the number of words read, or a negative value on error.
+	///
+	int readBufferV(const jtagSegment* segments, size_t count);
+
+	///
+	/// @brief Copies a block of 32-bit words from the CPU to the FPGA through the JTAG_BRIDGE, like memcpy().
+	/// The address is a word address on the Avalon bus of the bridge (e.g. the SDRAM). The data is shifted
+	/// by the DMA controller in a single continuous scan.
+	/// @return bool - false if the bridge did not respond.
+	///
+	bool copyToFPGA(uint32_t address, const void* src, size_t words);
+
+	///
+	/// @brief Copies a block of 32-bit words from the FPGA to the CPU through the JTAG_BRIDGE, like memcpy().
+	/// The address is a word address on the Avalon bus of the bridge (e.g. the SDRAM).
+	/// @return bool - false if the bridge did not respond.
+	///
+	bool copyFromFPGA(void* dst, uint32_t address, size_t words);
+
+	///
+	/// @brief Returns the throughput of the last copyToFPGA() or copyFromFPGA() call in MB/s.
+	///
+	float getTransferRate();
+
+	///
+	/// @brief Configures a ROI_READER block (FPGA/ip/ROI_READER) through the two output registers
+	/// configIndex and configIndex + 1, statusIndex is the input register its status is connected to.
+	/// frameWidth x frameHeight is the size of the camera frame, frameWidth must be the pHRES of the block.
+	/// The region starts at source pixel (x, y) and is width x height pixels large after taking every
+	/// step-th pixel, or averaging step x step pixels if binning is set.
+	/// @return bool - false if the region cannot be captured by the block, e.g. if it is wider than
+	/// its pMAX_WIDTH, larger than a bank or runs past the edge of the frame. Such a region would never
+	/// be completed.
+	///
+	bool setRegionOfInterest(uint8_t configIndex, uint8_t statusIndex, uint16_t frameWidth, uint16_t frameHeight,
+		uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t step = 1, bool binning = false);
+
+	///
+	/// @brief Reads the last complete region of a ROI_READER block as 8-bit luminance pixels through the
+	/// JTAG_BRIDGE. statusIndex is the input register its status is connected to, bufferAddress the word
+	/// address of its buffer on the bridge. bytes must be a multiple of 4. If a new frame completes
+	/// during the copy, the region is read again, up to FPGA_ROI_RETRIES times.
+	/// @return int - the frame counter of the region, or -1 if bytes is not a multiple of 4, no region
+	/// is available yet or the copy did not get a consistent frame.
+	///
+	int readRegionOfInterest(uint8_t statusIndex, uint32_t bufferAddress, void* dst, size_t bytes);
+
 	///
 	/// @brief Returns the pointer to the error message. If there was no error, the message is empty.
 	///
@@ -119,13 +405,46 @@ public:
 	}
 
 private:
+	template<int RegisterWidth, int NumRegisters> friend class FPGAInterface;	// Uses the raw scans below
+	friend class FPGARegisterFile;
+
 	uint32_t makeAddress(uint8_t writeAddr, uint8_t readAddr);
 	struct _ModuleInfo getIdentifier();
+	bool findInterface(int numOfRegisters);
+	bool readRegisterTable(const _ModuleInfo& info);
+	bool reserveRegisterTable(int entries);
 
 	void incrementStateMachine(uint8_t numticks, uint16_t path);
 	void readRaw(uint16_t IR, void* data, uint32_t numbits);
 	void writeRaw(uint16_t IR, const void* data, uint32_t numbits);
 	void transferRaw(uint16_t IR, const void* send, void* recv, uint32_t numbits);
+	void writeInstruction(uint32_t address, bool cached = true);
+	void selectInstruction(uint32_t vir, uint32_t numbits);
+	void scanInstruction(uint32_t vir, uint32_t numbits);
+	void shiftData(const void* send, void* recv, uint32_t numbits);
+	void shiftData(const void* send, void* recv, int numBytes, int tailBits);
+	void scanData(const void* send, void* recv, int numBytes, int tailBits);
+	uint8_t transferWidth(uint8_t txIndex, uint8_t rxIndex);
+	bool transferBurst(const int64_t* txValues, uint8_t txIndex, int64_t* rxValues, uint8_t rxIndex, uint8_t count, 
+		uint8_t operation = 0);
+	bool modify(uint8_t index, uint8_t operation, int64_t operand);
+	int64_t readWithTimestamp(uint32_t address, uint8_t bits, uint32_t* timestamp);
+	int readChangedRegisters(int64_t* values, uint8_t* changed, FPGAChangeCallback callback, const uint8_t* mask);
+	void updateInterruptMask();
+	void serviceInterrupt();
+	static void interruptHandler();
+	static bool preemptionPending();
+	static void servicePreemption();
+	void preemptScan(uint32_t address, bool cached);
+	static void dispatchChange(uint8_t index, int64_t value);
+
+	// Held during every transaction, so the interrupt handler never starts one in the middle of another. Leaves
+	// interrupts as it found them, so accesses also work inside noInterrupts() and in interrupt handlers
+	struct Lock {
+		Lock();
+		~Lock();
+		uint32_t primask;
+	};
 
 	void setup();
 	void shutdown();
@@ -135,6 +454,10 @@ private:
 	unsigned int pulseTDIO(int bits, unsigned int out);
 	unsigned int pulseTDIO_instruction(int bits, unsigned int out);
 	void pulseTDIO_SPI(const void* send, void* recv, size_t size);
+	void pulseTDIO_DMA(const void* send, void* recv, size_t size);
+	void startDMA(uint8_t channel, uint8_t trigger, uint16_t btctrl, uint32_t src, uint32_t dst, uint16_t beats);
+	bool setupDMA();
+	bool attachBridge();
 
 	char errorMessage[128];
 	bool error = false;
@@ -144,8 +467,41 @@ private:
 	int totalRegisters = 0;
 	int addressWidth = 0;
 	uint32_t addressBitmask = 0;
+	int features = 0;
+	uint8_t* widthTable = nullptr;		// All banks, allocated by begin() and kept
+	uint8_t* flagTable = nullptr;
+	int tableEntries = 0;
+	uint8_t* registerWidths = widthTable;		// Selected bank
+	uint8_t* registerFlags = flagTable;
+	int numBanks = 1;
+	uint8_t bank = 0;
+	bool uniformWidths = true;
+	struct _ModuleInfo moduleInfo;
+
+	uint8_t instance = 0;
+	int virSize = 0;				// Width of the virtual IR of the hub
+	int instructionLength = 0;		// Virtual IR and slave select bits
+	uint32_t slaveSelect = 0;
+	bool bridgeAttached = false;
+	bool dmaAvailable = false;
+	float transferRate = 0;
+
+	const int IDRegSize = 32;	// This value is fixed 
+
+	// Shared by all instances
+	static bool bitstreamLoaded;
+	static uint32_t lastInstruction;	// Last virtual IR shifted into the hub, including the slave select bits
+	static bool instructionValid;
+	static volatile uint8_t lockDepth;
+	static volatile bool interruptPending;
+	static bool interruptAttached;
+	static FPGAUrgentFunction volatile urgentFunctions[FPGA_MAX_URGENT];	// Waiting for the bus, see runUrgent()
+	static volatile uint8_t numUrgent;
+	static bool preempting;
 
-	const int IDRegSize = 16;	// This value is fixed 
+	uint8_t interruptMask[(254 + 7) / 8] = { 0 };	// Shifted in with the change flags
+	uint8_t callbackIndex[FPGA_MAX_CHANGE_CALLBACKS];
+	FPGAChangeCallback callbacks[FPGA_MAX_CHANGE_CALLBACKS] = { nullptr };
 };
 
 extern _FPGA FPGA;
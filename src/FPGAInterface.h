@@ -0,0 +1,370 @@
+//
+// Compile-time specialized version of the FPGA register functions. The register width and the
+// number of registers are template parameters, so the address width, the instruction and the split
+// into SPI bytes and remaining bits are constants, and the values use the smallest fitting integer
+// type instead of int64_t. Use it instead of FPGA.begin()/read()/write() when the access time matters:
+//
+//     FPGAInterface<32, 16> fpga;
+//
+//     fpga.begin();
+//     fpga.write<5>(1234);             // Index is checked at compile time
+//     uint32_t ticks = fpga.read(9);   // Index is checked at runtime
+//
+// It uses the global FPGA object, so FPGA.readBurst() and the other functions can still be used.
+// Register<> and InputRegister<> below bind a data type and an index to a register, FieldRegister<>
+// combines changes of several RegisterField<> into one write.
+//
+
+#ifndef FPGA_INTERFACE_H
+#define FPGA_INTERFACE_H
+
+#include "FPGA.h"
+
+template<bool Condition, typename True, typename False>
+struct _SelectType { typedef True type; };
+
+template<typename True, typename False>
+struct _SelectType<false, True, False> { typedef False type; };
+
+// Smallest unsigned integer type holding the given number of bits
+template<int Bits>
+struct _RegisterType {
+	typedef typename _SelectType<(Bits <= 8), uint8_t,
+			typename _SelectType<(Bits <= 16), uint16_t,
+			typename _SelectType<(Bits <= 32), uint32_t, uint64_t>::type>::type>::type type;
+};
+
+// Bits of a register from a value and back, the bits above the value are zero like with FPGA.toBytes<>().
+// Integers and enums go through the unsigned type of the same size, which masks off the sign extension of
+// negative values. Both directions are constant expressions.
+template<typename Bits, typename T>
+struct _RegisterLayout {
+	typedef typename _RegisterType<sizeof(T) * 8>::type Unsigned;
+
+	static constexpr Bits pack(T value) {
+		return (Bits)(Unsigned)value;
+	}
+
+	static constexpr T unpack(Bits bits) {
+		return (T)(Unsigned)bits;
+	}
+};
+
+// Floating point values keep their IEEE 754 bits. memcpy() is the defined way to get at them and compiles
+// to a register move, but it is not a constant expression
+template<typename Bits>
+struct _RegisterLayout<Bits, float> {
+	static Bits pack(float value) {
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	static float unpack(Bits bits) {
+		uint32_t raw = (uint32_t)bits;
+		float value;
+		memcpy(&value, &raw, sizeof(value));
+		return value;
+	}
+};
+
+template<typename Bits>
+struct _RegisterLayout<Bits, double> {
+	static Bits pack(double value) {
+		uint64_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	static double unpack(Bits bits) {
+		uint64_t raw = (uint64_t)bits;
+		double value;
+		memcpy(&value, &raw, sizeof(value));
+		return value;
+	}
+};
+
+template<typename Bits, typename T>
+constexpr Bits _packRegister(T value) {
+	return _RegisterLayout<Bits, T>::pack(value);
+}
+
+template<typename T, typename Bits>
+constexpr T _unpackRegister(Bits bits) {
+	return _RegisterLayout<Bits, T>::unpack(bits);
+}
+
+static_assert(_packRegister<uint32_t>((int16_t)-2) == 0xFFFEUL, "Register bits above a value must be zero.");
+static_assert(_unpackRegister<int8_t>((uint16_t)0xFF) == -1, "Register bits must convert back to the value.");
+
+///
+/// @brief Describes a bitfield inside a register, use it with FPGAInterface<>::FieldRegister:
+///
+///     struct Control {
+///         typedef RegisterField<0, 1> Enable;     // Bit 0
+///         typedef RegisterField<4, 4> Gain;       // Bits 4 to 7
+///     };
+///
+template<uint8_t Offset, uint8_t Width>
+struct RegisterField {
+	static_assert(Width > 0 && Offset + Width <= 64, "The field does not fit into a register.");
+
+	static constexpr uint8_t offset = Offset;
+	static constexpr uint8_t width = Width;
+};
+
+constexpr int _ceilLog2(uint32_t value, int bits = 0) {
+	return ((1UL << bits) >= value) ? bits : _ceilLog2(value, bits + 1);
+}
+
+template<int RegisterWidth, int NumRegisters>
+class FPGAInterface {
+public:
+	static_assert(RegisterWidth >= 8 && RegisterWidth <= 64, "Register width is out of bounds. Values between 8 and 64 are allowed.");
+	static_assert(NumRegisters >= 2 && NumRegisters <= 254, "Number of registers is out of bounds. Values between 2 and 254 are allowed.");
+
+	typedef typename _RegisterType<RegisterWidth>::type value_type;
+
+	static constexpr int addressWidth = _ceilLog2(NumRegisters + 1);
+	static constexpr uint32_t addressBitmask = (1UL << addressWidth) - 1;
+	static constexpr int numBytes = (RegisterWidth - 1) / 8;			// Shifted with SPI
+	static constexpr int tailBits = RegisterWidth - numBytes * 8;		// Shifted bit by bit
+
+	///
+	/// @brief Upload the FPGA_Bitstream.h to the FPGA, same as FPGA.begin(RegisterWidth, NumRegisters).
+	/// @return bool - false if the configuration does not match with the FPGA module.
+	///
+	bool begin() {
+		if (!FPGA.begin(RegisterWidth, NumRegisters)) return false;
+
+		if (!FPGA.uniformWidths) {
+			strncpy(FPGA.errorMessage, "FPGAInterface<> needs registers of equal width, "
+				"use FPGA.read()/write() for bitstreams with REGISTER_WIDTHS.", sizeof(FPGA.errorMessage));
+			FPGA.error = true;
+			return false;
+		}
+		return true;
+	}
+
+	///
+	/// @brief Same as begin(), but also checks the build hash of the module, e.g. the mapHash of a header
+	/// generated by extras/regmap/regmap.py. A bitstream built from another register map fails with an error.
+	/// @return bool - false if the configuration or the build hash does not match with the FPGA module.
+	///
+	bool begin(uint32_t buildHash) {
+		if (!begin()) return false;
+
+		if (FPGA.getModuleInfo().buildHash != buildHash) {
+			strncpy(FPGA.errorMessage, "The build hash of the FPGA module does not match, "
+				"the bitstream was built from another register map.", sizeof(FPGA.errorMessage));
+			FPGA.error = true;
+			return false;
+		}
+		return true;
+	}
+
+	///
+	/// @brief Returns the pointer to the error message. If there was no error, the message is empty.
+	///
+	const char* getErrorMessage() {
+		return FPGA.getErrorMessage();
+	}
+
+	///
+	/// @brief Reads a register, the index is checked at compile time.
+	///
+	template<uint8_t Index>
+	value_type read() {
+		static_assert(Index < NumRegisters, "Register index is out of bounds.");
+		return transferValue(-1, Index, 0);
+	}
+
+	///
+	/// @brief Reads a register. Returns 0 if the index is out of bounds.
+	///
+	value_type read(uint8_t index) {
+		if (index >= NumRegisters) return 0;
+		return transferValue(-1, index, 0);
+	}
+
+	///
+	/// @brief Writes a register, the index is checked at compile time.
+	///
+	template<uint8_t Index>
+	void write(value_type value) {
+		static_assert(Index < NumRegisters, "Register index is out of bounds.");
+		transferValue(Index, -1, value);
+	}
+
+	///
+	/// @brief Writes a register. Nothing is written if the index is out of bounds.
+	///
+	void write(uint8_t index, value_type value) {
+		if (index >= NumRegisters) return;
+		transferValue(index, -1, value);
+	}
+
+	///
+	/// @brief Writes one register while reading another one in the same scan, the indices are
+	/// checked at compile time.
+	///
+	template<uint8_t ReadIndex, uint8_t WriteIndex>
+	value_type transfer(value_type value) {
+		static_assert(ReadIndex < NumRegisters && WriteIndex < NumRegisters, "Register index is out of bounds.");
+		return transferValue(WriteIndex, ReadIndex, value);
+	}
+
+	///
+	/// @brief Writes one register while reading another one in the same scan. Returns 0 if an index
+	/// is out of bounds.
+	///
+	value_type transfer(uint8_t readIndex, uint8_t writeIndex, value_type value) {
+		if (readIndex >= NumRegisters || writeIndex >= NumRegisters) return 0;
+		return transferValue(writeIndex, readIndex, value);
+	}
+
+	///
+	/// @brief Extracts a RegisterField<> from a register value, e.g. from a packed input register.
+	///
+	template<typename Field>
+	static value_type getField(value_type bits) {
+		static_assert(Field::offset + Field::width <= RegisterWidth, "The field does not fit into the register.");
+		return (bits & fieldMask<Field>()) >> Field::offset;
+	}
+
+	///
+	/// @brief Handle for an output register with a fixed index and data type:
+	///
+	///     FPGAInterface<32, 16>::Register<float, 5> speedSetpoint;
+	///     speedSetpoint = 18.7f;      // Same as fpga.write<5>(), without converting through int64_t
+	///
+	/// T is an integer, enum, float or double type.
+	///
+	template<typename T, uint8_t Index>
+	class Register {
+	public:
+		static_assert(sizeof(T) * 8 <= RegisterWidth, "The data type does not fit into the register.");
+		static_assert(Index < NumRegisters, "Register index is out of bounds.");
+
+		Register& operator=(T value) {
+			transferValue(Index, -1, _packRegister<value_type>(value));
+			return *this;
+		}
+	};
+
+	///
+	/// @brief Handle for an input register with a fixed index and data type:
+	///
+	///     FPGAInterface<32, 16>::InputRegister<uint32_t, 9> ticks;
+	///     uint32_t now = ticks;       // Same as fpga.read<9>()
+	///
+	template<typename T, uint8_t Index>
+	class InputRegister {
+	public:
+		static_assert(sizeof(T) * 8 <= RegisterWidth, "The data type does not fit into the register.");
+		static_assert(Index < NumRegisters, "Register index is out of bounds.");
+
+		operator T() const {
+			return _unpackRegister<T>(transferValue(-1, Index, 0));
+		}
+	};
+
+	///
+	/// @brief Output register made of bitfields. The last written value is kept on the CPU, so any number
+	/// of fields can be changed with a single write and without reading the register back:
+	///
+	///     FPGAInterface<32, 16>::FieldRegister<2> control;
+	///     control.update().set<Control::Enable>(1).set<Control::Gain>(7).write();
+	///
+	/// The value of the registers on the FPGA is 0 after startup, like the shadow value here.
+	///
+	template<uint8_t Index>
+	class FieldRegister {
+	public:
+		static_assert(Index < NumRegisters, "Register index is out of bounds.");
+
+		///
+		/// @brief Collects field changes, write() transfers all of them at once.
+		///
+		class Update {
+		public:
+			Update(FieldRegister& reg) : reg(reg), bits(reg.shadow) {}
+
+			template<typename Field>
+			Update& set(value_type value) {
+				static_assert(Field::offset + Field::width <= RegisterWidth, "The field does not fit into the register.");
+				bits = (bits & ~fieldMask<Field>()) | ((value << Field::offset) & fieldMask<Field>());
+				return *this;
+			}
+
+			///
+			/// @brief Writes the register, unless no bit has changed.
+			///
+			void write() {
+				if (bits != reg.shadow) reg.write(bits);
+			}
+
+		private:
+			FieldRegister& reg;
+			value_type bits;
+		};
+
+		Update update() {
+			return Update(*this);
+		}
+
+		///
+		/// @brief Changes a single field.
+		///
+		template<typename Field>
+		void set(value_type value) {
+			update().template set<Field>(value).write();
+		}
+
+		///
+		/// @brief Returns a field of the last written value.
+		///
+		template<typename Field>
+		value_type get() const {
+			return getField<Field>(shadow);
+		}
+
+		///
+		/// @brief Writes the whole register and replaces the shadow value.
+		///
+		void write(value_type value) {
+			transferValue(Index, -1, value);
+			shadow = value;
+		}
+
+		value_type value() const {
+			return shadow;
+		}
+
+	private:
+		value_type shadow = 0;
+	};
+
+private:
+	template<typename Field>
+	static constexpr value_type fieldMask() {
+		return (Field::width >= sizeof(value_type) * 8) ? (value_type)~0 :
+			(value_type)((((value_type)1 << Field::width) - 1) << Field::offset);
+	}
+
+	static constexpr uint32_t makeInstruction(uint8_t writeIndex, uint8_t readIndex) {
+		return (1UL << (addressWidth * 2)) | ((writeIndex & addressBitmask) << addressWidth) | (readIndex & addressBitmask);
+	}
+
+	static value_type transferValue(uint8_t writeIndex, uint8_t readIndex, value_type value) {
+		if (FPGA.error) return 0;
+
+		value_type recv = 0;
+		_FPGA::Lock lock;
+		FPGA.selectInstruction(FPGA.slaveSelect | makeInstruction(writeIndex, readIndex), FPGA.instructionLength);
+		FPGA.scanData(&value, &recv, numBytes, tailBits);
+		return recv;
+	}
+};
+
+#endif // FPGA_INTERFACE_H
@@ -0,0 +1,111 @@
+#include "FPGARegisterFile.h"
+
+#define JTAG_ANY_TO_SIR() port.incrementStateMachine(10, 0b0011011111);
+#define JTAG_SIR_TO_SDR() port.incrementStateMachine(5, 0b00111);
+#define JTAG_RESET() port.incrementStateMachine(5, 0b11111);
+#define JTAG_SDR_TO_SDR() port.incrementStateMachine(5, 0b00111);
+
+bool FPGARegisterFile::begin() {
+	size = 0;
+	port.error = false;
+	memset(port.errorMessage, 0, sizeof(port.errorMessage));
+
+	if (!_FPGA::bitstreamLoaded) {
+		strncpy(port.errorMessage, "The bitstream is not loaded, call FPGA.begin() first.", sizeof(port.errorMessage));
+		port.error = true;
+		return false;
+	}
+
+	_FPGA::Lock lock;
+	if (!port.findInterface(0)) {
+		strncpy(port.errorMessage, "No register file was found in the virtual JTAG hub. "
+			"Make sure the right FPGA bitstream is loaded.", sizeof(port.errorMessage));
+		port.error = true;
+		return false;
+	}
+
+	struct _ModuleInfo info = port.getIdentifier();
+	int bits = (int)ceil(log2(info.registerFileSize + 1));
+
+	if (info.registerFileSize == 0 || info.registerSize < 1 || info.registerSize > 64 || bits + 1 > port.virSize) {
+		strncpy(port.errorMessage, "The JTAG module with this instance number is not a jtag_register_file. "
+			"Make sure the right FPGA bitstream is being loaded.", sizeof(port.errorMessage));
+		port.error = true;
+		return false;
+	}
+
+	port.moduleInfo = info;
+	size = info.registerFileSize;
+	width = info.registerSize;
+	addressWidth = bits;
+	instruction = 0;
+	return true;
+}
+
+int64_t FPGARegisterFile::read(uint16_t address) {
+	int64_t value = 0;
+	transfer(nullptr, &value, address, 1);
+	return value;
+}
+
+bool FPGARegisterFile::write(uint16_t address, int64_t value) {
+	return transfer(&value, nullptr, address, 1);
+}
+
+bool FPGARegisterFile::read(uint16_t address, int64_t* values, uint16_t count) {
+	return transfer(nullptr, values, address, count);
+}
+
+bool FPGARegisterFile::write(uint16_t address, const int64_t* values, uint16_t count) {
+	return transfer(values, nullptr, address, count);
+}
+
+uint16_t FPGARegisterFile::getSize() {
+	return size;
+}
+
+int FPGARegisterFile::getWidth() {
+	return width;
+}
+
+const char* FPGARegisterFile::getErrorMessage() {
+	return port.getErrorMessage();
+}
+
+bool FPGARegisterFile::transfer(const int64_t* txValues, int64_t* rxValues, uint16_t address, uint16_t count) {
+	if (port.error || (uint32_t)address + count > size) return false;
+	if (count == 0) return true;
+	_FPGA::Lock lock;
+
+	// Continue the burst of the last instruction if it is still selected in the hub and ends at this address,
+	// otherwise its UPDATE-IR restarts the FPGA at the new address
+	bool write = (txValues != nullptr);
+	bool writing = (instruction >> addressWidth) & 1;
+	if (!_FPGA::instructionValid || _FPGA::lastInstruction != instruction || position != address || writing != write) {
+		instruction = ((uint32_t)write << addressWidth) | address | port.slaveSelect;
+		port.scanInstruction(instruction, port.instructionLength);
+	}
+
+	int64_t writeDummy = 0, readDummy = 0;
+
+	JTAG_ANY_TO_SIR();
+	port.pulseTDIO_instruction(10, 12);
+	JTAG_SIR_TO_SDR();
+
+	for (uint16_t i = 0; i < count; i++) {
+		if (i > 0 && _FPGA::preemptionPending()) {
+			// Urgent accesses first, then a new burst from this word on
+			instruction = ((uint32_t)write << addressWidth) | (uint16_t)(address + i) | port.slaveSelect;
+			port.preemptScan(instruction, false);
+		}
+		else if (i > 0) {
+			JTAG_SDR_TO_SDR();
+		}
+		if (rxValues != nullptr) rxValues[i] = 0;
+		port.shiftData(write ? &txValues[i] : &writeDummy, rxValues ? &rxValues[i] : &readDummy, width);
+	}
+
+	JTAG_RESET();
+	position = address + count;
+	return true;
+}
@@ -0,0 +1,83 @@
+//
+// Access to a jtag_register_file in the bitstream, a block RAM of up to 65535 words that is a separate slave
+// of the virtual JTAG hub, next to jtag_interface:
+//
+//     FPGARegisterFile table(1);       // INSTANCE parameter of jtag_register_file
+//
+//     FPGA.begin();                    // Uploads the bitstream
+//     table.begin();
+//     table.write(1200, coefficients, 256);
+//     int64_t gain = table.read(17);
+//
+// The instruction only holds the address and a write bit, and the FPGA advances the address after every word.
+// So a block of words costs one instruction, and a transfer that starts where the last one of the same
+// direction stopped does not shift a new instruction at all, like reading a table word by word.
+//
+
+#ifndef FPGA_REGISTER_FILE_H
+#define FPGA_REGISTER_FILE_H
+
+#include "FPGA.h"
+
+class FPGARegisterFile {
+public:
+	FPGARegisterFile(uint8_t instance) : port(instance) {}
+
+	///
+	/// @brief Finds the register file in the virtual JTAG hub and reads its size. FPGA.begin() must have
+	/// uploaded the bitstream before.
+	/// @return bool - false if the instance is not a jtag_register_file.
+	///
+	bool begin();
+
+	///
+	/// @brief Reads a word. Returns 0 if the address is out of bounds.
+	///
+	int64_t read(uint16_t address);
+
+	///
+	/// @brief Writes a word.
+	/// @return bool - false if the address is out of bounds.
+	///
+	bool write(uint16_t address, int64_t value);
+
+	///
+	/// @brief Reads count consecutive words starting at address.
+	/// @return bool - false if the words are out of bounds.
+	///
+	bool read(uint16_t address, int64_t* values, uint16_t count);
+
+	///
+	/// @brief Writes count consecutive words starting at address.
+	/// @return bool - false if the words are out of bounds.
+	///
+	bool write(uint16_t address, const int64_t* values, uint16_t count);
+
+	///
+	/// @brief Returns the number of words, 0 before begin() succeeded.
+	///
+	uint16_t getSize();
+
+	///
+	/// @brief Returns the number of bits of every word.
+	///
+	int getWidth();
+
+	///
+	/// @brief Returns the pointer to the error message. If there was no error, the message is empty.
+	///
+	const char* getErrorMessage();
+
+private:
+	bool transfer(const int64_t* txValues, int64_t* rxValues, uint16_t address, uint16_t count);
+
+	_FPGA port;
+	uint16_t size = 0;
+	int width = 0;
+	int addressWidth = 0;
+
+	uint32_t instruction = 0;	// Last instruction shifted by this object
+	uint16_t position = 0;		// Address the FPGA accesses with the next scan of that instruction
+};
+
+#endif // FPGA_REGISTER_FILE_H
@@ -0,0 +1,169 @@
+#include "FPGATiming.h"
+
+static void addLatency(FPGALatency& result, float latency) {
+	if (result.samples == 0 || latency < result.min) result.min = latency;
+	if (result.samples == 0 || latency > result.max) result.max = latency;
+	result.mean += (latency - result.mean) / (result.samples + 1);
+	result.samples++;
+}
+
+bool FPGATiming::begin(uint8_t tickRegister, float tickMHz, uint32_t interval) {
+	if (tickRegister == FPGA_TIMING_TIMESTAMPS) {
+		tickBits = fpga.getModuleInfo().timestampWidth;
+	}
+	else {
+		tickBits = min(fpga.getRegisterWidth(tickRegister), 32);
+	}
+	if (tickBits == 0 || tickMHz <= 0) return false;
+
+	this->tickRegister = tickRegister;
+	this->nominalRate = tickMHz;
+	this->interval = interval;
+	numSamples = 0;
+	nextSample = 0;
+	started = true;
+	return sample();
+}
+
+bool FPGATiming::update() {
+	if (!started || micros() - lastSample < interval) return false;
+	return sample();
+}
+
+bool FPGATiming::sample() {
+	if (!started) return false;
+
+	// An interrupt between the two micros() makes the sample less exact, the narrowest of three is kept
+	uint32_t bestMicros = 0, bestWidth = 0xFFFFFFFF, bestTicks = 0;
+	for (int i = 0; i < 3; i++) {
+		uint32_t before = micros();
+		uint32_t ticks = readTicks();
+		uint32_t width = micros() - before;
+
+		if (width < bestWidth) {
+			bestWidth = width;
+			bestMicros = before + width / 2;
+			bestTicks = ticks;
+		}
+	}
+
+	int64_t ticks = (numSamples == 0) ? bestTicks : unwrap(bestTicks);
+	sampleMicros[nextSample] = bestMicros;
+	sampleTicks[nextSample] = ticks;
+	nextSample = (nextSample + 1) % FPGA_TIMING_SAMPLES;
+	if (numSamples < FPGA_TIMING_SAMPLES) numSamples++;
+
+	lastTicks = ticks;
+	lastSample = bestMicros;
+	fit();
+	return true;
+}
+
+void FPGATiming::fit() {
+
+	// Relative to the oldest sample, so the values stay small
+	int oldest = (numSamples < FPGA_TIMING_SAMPLES) ? 0 : nextSample;
+	originMicros = sampleMicros[oldest];
+	originTicks = sampleTicks[oldest];
+
+	if (numSamples < 2) {
+		offset = 0;
+		rate = nominalRate;
+		residual = 0;
+		return;
+	}
+
+	double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+	for (int i = 0; i < numSamples; i++) {
+		double x = (int32_t)(sampleMicros[i] - originMicros);
+		double y = sampleTicks[i] - originTicks;
+		sumX += x;
+		sumY += y;
+		sumXX += x * x;
+		sumXY += x * y;
+	}
+
+	double denominator = numSamples * sumXX - sumX * sumX;
+	if (denominator <= 0) return;
+	rate = (numSamples * sumXY - sumX * sumY) / denominator;
+	offset = (sumY - rate * sumX) / numSamples;
+
+	double squares = 0;
+	for (int i = 0; i < numSamples; i++) {
+		double x = (int32_t)(sampleMicros[i] - originMicros);
+		double error = (sampleTicks[i] - originTicks - offset - rate * x) / rate;
+		squares += error * error;
+	}
+	residual = sqrt(squares / numSamples);
+}
+
+uint32_t FPGATiming::ticksToMicros(uint32_t ticks) {
+	if (!started) return 0;
+	double y = unwrap(ticks) - originTicks;
+	return originMicros + (int32_t)lround((y - offset) / rate);
+}
+
+uint32_t FPGATiming::microsToTicks(uint32_t time) {
+	if (!started) return 0;
+	double x = (int32_t)(time - originMicros);
+	return (uint32_t)(originTicks + (int64_t)llround(offset + rate * x));
+}
+
+float FPGATiming::getTickRate() {
+	return rate;
+}
+
+float FPGATiming::getDrift() {
+	return (rate / nominalRate - 1) * 1e6;
+}
+
+float FPGATiming::getResidual() {
+	return residual;
+}
+
+bool FPGATiming::measureReadLatency(FPGALatency& result, int iterations) {
+	result = FPGALatency();
+	if (!started) return false;
+
+	for (int i = 0; i < iterations; i++) {
+		uint32_t ticks = readTicks();
+		uint32_t now = micros();
+		addLatency(result, (int32_t)(now - ticksToMicros(ticks)));
+	}
+	return true;
+}
+
+bool FPGATiming::measureWriteLatency(uint8_t outputIndex, uint8_t probeIndex, FPGALatency& result, int iterations) {
+	result = FPGALatency();
+	if (!started || fpga.getRegisterWidth(outputIndex) == 0 || fpga.getRegisterWidth(probeIndex) == 0) return false;
+
+	// Without latency_probe.v the register holds anything, e.g. the tick counter, and the result would be noise
+	if (!(fpga.getRegisterDirection(probeIndex) & FPGA_REGISTER_PROBE)) return false;
+
+	// Start from a known value, so every write is a change
+	fpga.write(outputIndex, 0);
+	uint32_t previous = fpga.read(probeIndex);
+
+	for (int i = 0; i < iterations; i++) {
+		uint32_t start = micros();
+		fpga.write(outputIndex, (i & 1) ? 0 : 1);
+		uint32_t changed = fpga.read(probeIndex);
+
+		if (changed == previous) continue;		// The probe did not see the change
+		previous = changed;
+		addLatency(result, (int32_t)(ticksToMicros(changed) - start));
+	}
+	return result.samples > 0;
+}
+
+uint32_t FPGATiming::readTicks() {
+	if (tickRegister == FPGA_TIMING_TIMESTAMPS) return fpga.readTimestamp();
+	return (uint32_t)fpga.read(tickRegister);
+}
+
+int64_t FPGATiming::unwrap(uint32_t ticks) {
+	// Sign extended difference to the last sample, the counter wraps at its width
+	int shift = 32 - tickBits;
+	int32_t delta = (int32_t)((ticks - (uint32_t)lastTicks) << shift) >> shift;
+	return lastTicks + delta;
+}
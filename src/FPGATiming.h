@@ -0,0 +1,135 @@
+//
+// Relates the clock of the FPGA to micros() of the Arduino and measures the latency of register accesses
+// end to end, in microseconds of the Arduino:
+//
+//     FPGATiming timing;
+//
+//     timing.begin(9);                 // Register 9 of the default bitstream counts the 120 MHz clock
+//     timing.update();                 // In loop(), takes a new pair of ticks and micros() every second
+//
+//     FPGALatency latency;
+//     timing.measureReadLatency(latency);
+//
+// Every sample reads the tick counter between two micros() and keeps the middle. The last
+// FPGA_TIMING_SAMPLES samples are fitted with a line, which gives the offset and the drift of the FPGA
+// clock against the Arduino clock. ticksToMicros() then converts FPGA ticks, e.g. the capture timestamps of
+// FPGA.read(index, &timestamp), into micros() time.
+//
+// Sample-to-read latency: time from the FPGA capturing a register until FPGA.read() returned it.
+// Write-to-effect latency: time from calling FPGA.write() until the output register changed on the FPGA. This
+//   needs a probe input register that holds the tick at which the output register last changed, see
+//   latency_probe.v in the example project.
+//
+
+#ifndef FPGA_TIMING_H
+#define FPGA_TIMING_H
+
+#include "FPGA.h"
+
+#define FPGA_TIMING_SAMPLES 16			// Samples in the fit
+#define FPGA_TIMING_TIMESTAMPS 0xFF		// Tick source: the capture timestamps, see FPGA.readTimestamp()
+
+///
+/// @brief Result of a latency measurement, in microseconds.
+///
+struct FPGALatency {
+	float min = 0;
+	float mean = 0;
+	float max = 0;
+	int samples = 0;
+};
+
+class FPGATiming {
+public:
+	FPGATiming(_FPGA& fpga = FPGA) : fpga(fpga) {}
+
+	///
+	/// @brief Starts the correlation, FPGA.begin() must have succeeded. tickRegister is an input register with
+	/// a free-running counter of tickMHz, or FPGA_TIMING_TIMESTAMPS to use the counter of the capture timestamps.
+	/// update() takes a new sample every interval microseconds, it must be shorter than half the wrap of the
+	/// counter (17 seconds for 32 bits at 120 MHz).
+	/// @return bool - false if the tick source is not available.
+	///
+	bool begin(uint8_t tickRegister = 9, float tickMHz = 120, uint32_t interval = 1000000);
+
+	///
+	/// @brief Takes a sample if the interval has passed, call it from loop().
+	/// @return bool - true if a sample was taken.
+	///
+	bool update();
+
+	///
+	/// @brief Takes a sample now and fits the line again.
+	///
+	bool sample();
+
+	///
+	/// @brief Converts FPGA ticks into micros() time. Ticks up to half the counter range away from the last
+	/// sample are converted.
+	///
+	uint32_t ticksToMicros(uint32_t ticks);
+
+	///
+	/// @brief Converts micros() time into FPGA ticks, the inverse of ticksToMicros().
+	///
+	uint32_t microsToTicks(uint32_t time);
+
+	///
+	/// @brief Returns the measured frequency of the FPGA counter in MHz (ticks per microsecond of the Arduino).
+	///
+	float getTickRate();
+
+	///
+	/// @brief Returns the deviation of the measured from the nominal tick rate in ppm. Both crystals contribute.
+	///
+	float getDrift();
+
+	///
+	/// @brief Returns the RMS distance of the samples from the fitted line in microseconds, a measure of how
+	/// exact ticksToMicros() is.
+	///
+	float getResidual();
+
+	///
+	/// @brief Measures the time from the FPGA capturing the tick register until FPGA.read() returned it.
+	///
+	bool measureReadLatency(FPGALatency& result, int iterations = 100);
+
+	///
+	/// @brief Measures the time from calling FPGA.write(outputIndex) until the output changed on the FPGA.
+	/// probeIndex is the input register holding the tick of the last change of the output, the output is
+	/// toggled between 0 and 1.
+	/// @return bool - false if the descriptor does not report probeIndex as a probe (PROBE_REGISTERS of
+	/// jtag_interface), or if no change was seen.
+	///
+	bool measureWriteLatency(uint8_t outputIndex, uint8_t probeIndex, FPGALatency& result, int iterations = 100);
+
+private:
+	uint32_t readTicks();
+	int64_t unwrap(uint32_t ticks);
+	void fit();
+
+	_FPGA& fpga;
+	uint8_t tickRegister = 9;
+	uint8_t tickBits = 32;
+	float nominalRate = 120;
+	uint32_t interval = 1000000;
+	bool started = false;
+
+	// Ring of samples, the ticks are unwrapped to 64 bits
+	uint32_t sampleMicros[FPGA_TIMING_SAMPLES];
+	int64_t sampleTicks[FPGA_TIMING_SAMPLES];
+	int numSamples = 0;
+	int nextSample = 0;
+	uint32_t originMicros = 0;
+	int64_t originTicks = 0;
+	int64_t lastTicks = 0;
+	uint32_t lastSample = 0;
+
+	// ticks = offset + rate * (micros - originMicros)
+	double offset = 0;
+	double rate = 0;
+	float residual = 0;
+};
+
+#endif // FPGA_TIMING_H
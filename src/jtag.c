@@ -1,5 +1,21 @@
 #include "jtag.h"
 
+#if 1
+
+#define TDI 12
+#define TDO 15
+#define TCK 13
+#define TMS 14
+
+#else
+
+#define TDI 26
+#define TDO 29
+#define TCK 27
+#define TMS 28
+
+#endif
+
 /* JTAG State Machine */
 const int JSM[16][2] = {
   /*-State-      -mode= '0'-    -mode= '1'- */
@@ -531,7 +547,26 @@ static int jtagVIR(int instruction)
   return ret;
 }
 
-int jtagInit(void)
+/******************************************************************/
+/* Name:         jtagEnumerate                                    */
+/*                                                                */
+/* Parameters:   hub                                              */
+/*               -hub receives the slave count, the widths of the */
+/*                slave select bits and of the virtual IR, and    */
+/*                the node records of the first JTAG_MAX_NODES    */
+/*                slaves.                                         */
+/*                                                                */
+/* Return Value: Number of slaves, -1 if no hub was found.        */
+/*               		                                          */
+/* Descriptions: Reads the hub info and the node records of the   */
+/*               virtual JTAG hub. A node record contains the     */
+/*               type ([26:19]), the vendor ([18:8]) and the      */
+/*               instance ([7:0]) of the slave. The slave n is    */
+/*               selected with the value n + 1 in the slave bits  */
+/*               above the virtual IR.                            */
+/*                                                                */
+/******************************************************************/
+int jtagEnumerate(jtagHub* hub)
 {
   int i, j;
   unsigned int record;
@@ -561,7 +596,6 @@ int jtagInit(void)
       Js_Updatedr();
       Js_Runidle();
     }
-    jtag.id = -1;
     jtag.lastVir = -1;
     if (((record >> 8) & 0x7ff) == JTAG_VENDOR_ID)
     {
@@ -569,6 +603,9 @@ int jtagInit(void)
       for (jtag.slaveBits = 0; (1 << jtag.slaveBits) < (jtag.nSlaves + 1); jtag.slaveBits++);
 
       jtag.virSize = record & 0xff;
+      hub->nSlaves = jtag.nSlaves;
+      hub->slaveBits = jtag.slaveBits;
+      hub->virSize = jtag.virSize;
       for (j = 0; j < jtag.nSlaves; j++)
       {
         record = 0;
@@ -579,12 +616,34 @@ int jtagInit(void)
           Js_Updatedr();
           Js_Runidle();
         }
-        if (((record >> 19) & 0xff) == JTAG_ID_VJTAG && ((record >> 8) & 0x7ff) == JTAG_VENDOR_ID)
-        {
-          jtag.id = j;
-          return 0;
-        }
+        if (j < JTAG_MAX_NODES)
+          hub->nodes[j] = record;
       }
+      return jtag.nSlaves;
+    }
+  }
+  return -1;
+}
+
+/* The virtual IR was changed by someone else, select the bridge again */
+void jtagInvalidateVIR(void)
+{
+  jtag.lastVir = -1;
+}
+
+int jtagInit(void)
+{
+  jtagHub hub;
+  int j, n;
+
+  jtag.id = -1;
+  n = jtagEnumerate(&hub);
+  for (j = 0; j < n && j < JTAG_MAX_NODES; j++)
+  {
+    if (JTAG_NODE_TYPE(hub.nodes[j]) == JTAG_ID_VJTAG && JTAG_NODE_VENDOR(hub.nodes[j]) == JTAG_VENDOR_ID)
+    {
+      jtag.id = j;
+      return 0;
     }
   }
   return -1;
@@ -615,7 +674,7 @@ int jtagWriteBuffer(unsigned int address, const uint8_t *data, size_t len)
   LoadJI(JI_USER0_VDR);
   Js_Shiftdr();
   address = (address << 2) | 0x00000003;
-  ReadTDOBuf(32, &address, 0, 0);
+  ReadTDOBuf(32, (char*)&address, 0, 0);
   ReadTDOBuf(32 * len+2, data, 0, 0);
   return len;
 }
@@ -630,11 +689,11 @@ int jtagReadBuffer(unsigned int address, uint8_t *data, size_t len)
   LoadJI(JI_USER0_VDR);
   Js_Shiftdr();
   address = (address << 2) | 0x00000003;
-  ReadTDOBuf(32, &address, 0, 0);
+  ReadTDOBuf(32, (char*)&address, 0, 0);
   if (len > 1)
   {
     address = len - 1;
-    ReadTDOBuf(4, &address, 0, 1);
+    ReadTDOBuf(4, (char*)&address, 0, 1);
   }
   ret = jtagVIR(JBC_READ);
   if (ret < 0) {
@@ -651,6 +710,220 @@ int jtagReadBuffer(unsigned int address, uint8_t *data, size_t len)
   return len;
 }
 
+/******************************************************************/
+/* Name:         jtagWriteBufferV                                 */
+/*                                                                */
+/* Parameters:   segments,count                                   */
+/*               -segments is the list of {address,data,len}      */
+/*                entries to write, len counted in 32-bit words.  */
+/*               -count is the number of entries in the list.     */
+/*                                                                */
+/* Return Value: Number of words written, negative on error.      */
+/*               		                                          */
+/* Descriptions: Writes all segments in one sequence. The VIR and */
+/*               the USER0 instruction are loaded only once, every*/
+/*               segment costs a single DR scan starting from     */
+/*               UPDATE_DR. Segments that continue at the address */
+/*               where the previous one stopped are streamed in   */
+/*               the same DR scan without a new address phase,    */
+/*               as the bridge increments the address by itself.  */
+/*                                                                */
+/******************************************************************/
+int jtagWriteBufferV(const jtagSegment* segments, size_t count)
+{
+  int ret = 0;
+  int total = 0;
+  size_t i;
+  unsigned int address, next = 0;
+
+  ret = jtagVIR(JBC_WRITE);
+  if (ret < 0) {
+	return ret;
+  }
+  LoadJI(JI_USER0_VDR);
+  for (i = 0; i < count; i++)
+  {
+    if (segments[i].len == 0)
+      continue;
+
+    if (jtag.state != JS_SHIFT_DR || segments[i].address != next)
+    {
+      /* Close the previous scan, the next capture restarts the address phase */
+      Js_Updatedr();
+      address = (segments[i].address << 2) | 0x00000003;
+      if (total == 0)
+      {
+        /* A first address-only scan resets the burst length that a previous read left in the bridge */
+        Js_Shiftdr();
+        ReadTDOBuf(32, (char*)&address, 0, 0);
+        Js_Updatedr();
+      }
+      Js_Shiftdr();
+      ReadTDOBuf(32, (char*)&address, 0, 0);
+    }
+    ReadTDOBuf(32 * segments[i].len, (char*)segments[i].data, 0, 0);
+    next = segments[i].address + segments[i].len;
+    total += segments[i].len;
+  }
+  /* Two more clocks so that the bridge commits the last word */
+  Js_Updatedr();
+  return total;
+}
+
+/******************************************************************/
+/* Name:         jtagReadBufferV                                  */
+/*                                                                */
+/* Parameters:   segments,count                                   */
+/*               -segments is the list of {address,data,len}      */
+/*                entries to read, len counted in 32-bit words.   */
+/*               -count is the number of entries in the list.     */
+/*                                                                */
+/* Return Value: Number of words read, negative on error.         */
+/*               		                                          */
+/* Descriptions: Reads all segments in bursts of at most          */
+/*               JBC_MAX_READ_BURST words. The bridge issues the  */
+/*               read command on UPDATE_IR, so every burst needs  */
+/*               an address scan and a VIR switch. The JSM is     */
+/*               always parked in UPDATE_DR between the scans so  */
+/*               that no burst pays for a full JSM reset.         */
+/*                                                                */
+/******************************************************************/
+int jtagReadBufferV(const jtagSegment* segments, size_t count)
+{
+  int ret = 0;
+  int total = 0;
+  size_t i, n, done;
+  unsigned int address;
+
+  for (i = 0; i < count; i++)
+  {
+    for (done = 0; done < segments[i].len; done += n)
+    {
+      n = segments[i].len - done;
+      if (n > JBC_MAX_READ_BURST)
+        n = JBC_MAX_READ_BURST;
+
+      /* Address phase, followed by the 4-bit burst length */
+      ret = jtagVIR(JBC_WRITE);
+      if (ret < 0) {
+        return ret;
+      }
+      LoadJI(JI_USER0_VDR);
+      Js_Shiftdr();
+      address = ((segments[i].address + done) << 2) | 0x00000003;
+      ReadTDOBuf(32, (char*)&address, 0, 0);
+      address = n - 1;
+      ReadTDOBuf(4, (char*)&address, 0, 1);
+      Js_Updatedr();
+
+      /* Switching to the read VIR issues the burst */
+      ret = jtagVIR(JBC_READ);
+      if (ret < 0) {
+        return ret;
+      }
+      LoadJI(JI_USER0_VDR);
+      Js_Shiftdr();
+      ReadTDOBuf(32 * n, 0, (char*)segments[i].data + 4 * done, 0);
+      Js_Updatedr();
+      total += n;
+    }
+  }
+  return total;
+}
+
+/******************************************************************/
+/* Name:         jtagBeginWrite                                   */
+/*                                                                */
+/* Parameters:   address                                          */
+/*               -the word address the data is written to.        */
+/*                                                                */
+/* Return Value: 0 if successful, negative on error.              */
+/*               		                                          */
+/* Descriptions: Runs the address phase of a bridge write and     */
+/*               leaves the JSM in SHIFT_DR, so that the caller   */
+/*               can shift any number of 32-bit words with a      */
+/*               faster engine. Finish with jtagEndTransfer().    */
+/*               A first address-only scan resets the burst       */
+/*               length that a previous read left in the bridge.  */
+/*                                                                */
+/******************************************************************/
+int jtagBeginWrite(unsigned int address)
+{
+  int ret = 0;
+  ret = jtagVIR(JBC_WRITE);
+  if (ret < 0) {
+	return ret;
+  }
+  LoadJI(JI_USER0_VDR);
+  address = (address << 2) | 0x00000003;
+  Js_Shiftdr();
+  ReadTDOBuf(32, (char*)&address, 0, 0);
+  Js_Updatedr();
+  Js_Shiftdr();
+  ReadTDOBuf(32, (char*)&address, 0, 0);
+  return ret;
+}
+
+/******************************************************************/
+/* Name:         jtagBeginRead                                    */
+/*                                                                */
+/* Parameters:   address,len                                      */
+/*               -the word address the data is read from.         */
+/*               -len is the number of 32-bit words to read, at   */
+/*                most JBC_MAX_READ_BURST.                        */
+/*                                                                */
+/* Return Value: 0 if successful, negative on error.              */
+/*               		                                          */
+/* Descriptions: Issues a bridge read burst and leaves the JSM in */
+/*               SHIFT_DR, so that the caller can shift the len   */
+/*               words out with a faster engine. Finish with      */
+/*               jtagEndTransfer().                               */
+/*                                                                */
+/******************************************************************/
+int jtagBeginRead(unsigned int address, size_t len)
+{
+  int ret = 0;
+  if (len == 0 || len > JBC_MAX_READ_BURST)
+    return -1;
+
+  ret = jtagVIR(JBC_WRITE);
+  if (ret < 0) {
+	return ret;
+  }
+  LoadJI(JI_USER0_VDR);
+  Js_Shiftdr();
+  address = (address << 2) | 0x00000003;
+  ReadTDOBuf(32, (char*)&address, 0, 0);
+  address = len - 1;
+  ReadTDOBuf(4, (char*)&address, 0, 1);
+  Js_Updatedr();
+
+  ret = jtagVIR(JBC_READ);
+  if (ret < 0) {
+	return ret;
+  }
+  LoadJI(JI_USER0_VDR);
+  Js_Shiftdr();
+  return ret;
+}
+
+/******************************************************************/
+/* Name:         jtagEndTransfer                                  */
+/*                                                                */
+/* Parameters:   None.                                            */
+/*                                                                */
+/* Return Value: None.                                            */
+/*               		                                          */
+/* Descriptions: Ends a transfer started with jtagBeginWrite() or */
+/*               jtagBeginRead() and parks the JSM in UPDATE_DR.  */
+/*               The caller must leave TCK low.                   */
+/*                                                                */
+/******************************************************************/
+void jtagEndTransfer(void)
+{
+  Js_Updatedr();
+}
+
 #define MB_BASE     0x00000000
 #define MB_INT_PIN  31
 #define MB_TIMEOUT  5000
@@ -25,7 +25,13 @@
 #define JSM_RESET_COUNT  5
 
 #define JTAG_VENDOR_ID   0x6E
-#define JTAG_ID_VJTAG    0x84
+#define JTAG_ID_VJTAG    0x84   /* JTAG_BRIDGE */
+#define JTAG_ID_VIRTUAL  0x08   /* sld_virtual_jtag, e.g. jtag_interface */
+
+#define JTAG_MAX_NODES   16
+#define JTAG_NODE_TYPE(record)     (((record) >> 19) & 0xff)
+#define JTAG_NODE_VENDOR(record)   (((record) >> 8) & 0x7ff)
+#define JTAG_NODE_INSTANCE(record) ((record) & 0xff)
 
 /* JTAG Instructions */
 #define  JI_EXTEST				0x000
@@ -48,6 +54,8 @@
 #define JBC_WRITE               0
 #define JBC_READ                1
 
+#define JBC_MAX_READ_BURST      4   /* depth of the bridge read FIFO */
+
 #define MAX_JTAG_INIT_CLOCK 3192
 #define CDF_IDCODE_LEN 32
 
@@ -57,29 +65,35 @@
 #define INST_LEN 10
 #define INIT_COUNT 200
 
-#if 1
-
-#define TDI 12
-#define TDO 15
-#define TCK 13
-#define TMS 14
+/* One entry of a scatter-gather transfer list: len 32-bit words at address */
+typedef struct jtagSegment {
+  unsigned int address;
+  uint8_t* data;
+  size_t len;
+} jtagSegment;
 
-#else
-
-#define TDI 26
-#define TDO 29
-#define TCK 27
-#define TMS 28
-
-#endif
+/* Virtual JTAG hub, filled by jtagEnumerate() */
+typedef struct jtagHub {
+  unsigned char nSlaves;
+  unsigned char slaveBits;
+  unsigned char virSize;
+  unsigned int nodes[JTAG_MAX_NODES];
+} jtagHub;
 
 #ifdef __cplusplus
 extern "C" {
 #endif
+int jtagEnumerate(jtagHub* hub);
+void jtagInvalidateVIR(void);
 int jtagInit(void);
 int jtagReload(void);
 int jtagWriteBuffer(unsigned int address, const uint8_t* data, size_t len);
 int jtagReadBuffer(unsigned int address, uint8_t* data, size_t len);
+int jtagWriteBufferV(const jtagSegment* segments, size_t count);
+int jtagReadBufferV(const jtagSegment* segments, size_t count);
+int jtagBeginWrite(unsigned int address);
+int jtagBeginRead(unsigned int address, size_t len);
+void jtagEndTransfer(void);
 void jtagDeinit(void);
 int mbPinSet(void);
 int mbCmdSend(uint32_t* data, int len);